@@ -0,0 +1,69 @@
+#ifndef FAST_PIN_H
+#define FAST_PIN_H
+#include <Arduino.h>
+
+/*******************compile time pins*********************/
+// FastPin<N> resolves the port and bit of pin N at compile time
+// write() and read() compile to single sbi / cbi / sbic instructions (atomic , no pin table lookup)
+// Arduino UNO numbering : 0..7 PORTD , 8..13 PORTB , 14..19 (A0..A5) PORTC
+
+#if defined(__AVR_ATmega328P__) || defined(__AVR_ATmega328__) || defined(__AVR_ATmega168__)
+#define FAST_PIN_AVAILABLE 1
+
+template <uint8_t PIN>
+struct FastPin {
+  static_assert(PIN < 20 , "FastPin : the ATmega328P/168 has pins 0..19");
+  static const uint8_t mask = 1 << ((PIN < 8) ? PIN : (PIN < 14) ? PIN - 8 : PIN - 14);
+
+  static inline volatile uint8_t &out() __attribute__((always_inline)) { return (PIN < 8) ? PORTD : (PIN < 14) ? PORTB : PORTC ; }
+  static inline volatile uint8_t &in() __attribute__((always_inline)) { return (PIN < 8) ? PIND : (PIN < 14) ? PINB : PINC ; }
+  static inline volatile uint8_t &mode() __attribute__((always_inline)) { return (PIN < 8) ? DDRD : (PIN < 14) ? DDRB : DDRC ; }
+
+  static inline void output() __attribute__((always_inline)) { mode() |= mask ; }
+  static inline void input() __attribute__((always_inline)) { mode() &= ~mask ; }
+  static inline void high() __attribute__((always_inline)) { out() |= mask ; }
+  static inline void low() __attribute__((always_inline)) { out() &= ~mask ; }
+  static inline bool read() __attribute__((always_inline)) { return in() & mask ; }
+} ;
+#else
+#define FAST_PIN_AVAILABLE 0     // other boards use RuntimePin
+#endif
+
+/*******************runtime pins*********************/
+// fallback for pins only known at runtime (ultrsnc_head_setup() arguments)
+// the pin table lookup is done once in attach() instead of in every digitalWrite()
+// writes are read-modify-write with interrupts off , the Servo interrupt writes to the same ports
+
+class RuntimePin {
+public:
+  void attach(uint8_t pin)
+  {
+    out = portOutputRegister(digitalPinToPort(pin));
+    in = portInputRegister(digitalPinToPort(pin));
+    mask = digitalPinToBitMask(pin);
+  }
+  inline void high()
+  {
+    if (!out){return ;}      // not attached
+    uint8_t sreg = SREG ;
+    cli();
+    *out |= mask ;
+    SREG = sreg ;
+  }
+  inline void low()
+  {
+    if (!out){return ;}
+    uint8_t sreg = SREG ;
+    cli();
+    *out &= ~mask ;
+    SREG = sreg ;
+  }
+  inline bool read() { return *in & mask ; }
+
+private:
+  volatile uint8_t *out = 0 ;
+  volatile uint8_t *in = 0 ;
+  uint8_t mask = 0 ;
+} ;
+
+#endif
@@ -0,0 +1,120 @@
+#include "GaitParams.h"
+#include "Protocol.h"
+#include <Arduino.h>
+#include <EEPROM.h>
+
+GaitTiming gait_table[GAIT_ID_COUNT];
+GaitStep gait_slot[GAIT_SLOT_STEPS];
+uint8_t gait_slot_count = 0 ;
+static uint8_t gait_slot_next = 0 ;     // index the next chunk of the upload must start at
+static uint8_t gait_slot_total = 0 ;    // table size announced by the upload's first chunk
+
+static const GaitTiming gait_presets[PRESET_COUNT] PROGMEM = {   // kept in flash , copied only when a preset is applied
+    { 700 , 400 } ,    // PRESET_STABLE
+    { 500 , 250 } ,    // PRESET_NORMAL
+    { 300 , 120 } ,    // PRESET_FAST
+};
+
+struct GaitEeprom {
+  uint8_t magic ;
+  uint8_t version ;
+  GaitTiming table[GAIT_ID_COUNT] ;
+  uint8_t crc ;          // crc8 of the table so a half written save is detected
+} ;
+
+
+static bool gait_valid(uint16_t t_motion_delayms , uint16_t t_stop_delayms)
+{
+    return t_motion_delayms >= GAIT_MIN_MS && t_motion_delayms <= GAIT_MAX_MS &&
+           t_stop_delayms >= GAIT_MIN_MS && t_stop_delayms <= GAIT_MAX_MS ;
+}
+
+bool gait_set_timing(uint8_t gait , uint16_t t_motion_delayms , uint16_t t_stop_delayms)
+{
+    if (!gait_valid(t_motion_delayms , t_stop_delayms)){return false ;}
+    if (gait != GAIT_ALL && gait >= GAIT_ID_COUNT){return false ;}
+
+    for (uint8_t i = 0 ; i < GAIT_ID_COUNT ; i++)
+    {
+        if (gait == GAIT_ALL || gait == i)
+        {
+            gait_table[i].motion_ms = t_motion_delayms ;
+            gait_table[i].stop_ms = t_stop_delayms ;
+        }
+    }
+    return true ;
+}
+
+bool gait_apply_preset(uint8_t gait , uint8_t preset)
+{
+    if (preset >= PRESET_COUNT){return false ;}
+
+    GaitTiming t ;
+    memcpy_P(&t , &gait_presets[preset] , sizeof(t));
+    return gait_set_timing(gait , t.motion_ms , t.stop_ms);
+}
+
+void gait_params_load()
+{
+    GaitEeprom saved ;
+    EEPROM.get(GAIT_EEPROM_ADDR , saved);
+
+    if (saved.magic == GAIT_EEPROM_MAGIC && saved.version == GAIT_EEPROM_VERSION &&
+        saved.crc == crc8((const uint8_t *)saved.table , sizeof(saved.table) , 0))
+    {
+        for (uint8_t i = 0 ; i < GAIT_ID_COUNT ; i++)
+        {
+            if (!gait_set_timing(i , saved.table[i].motion_ms , saved.table[i].stop_ms))
+            {
+                gait_apply_preset(i , PRESET_NORMAL);   // out of range entry (limits changed since it was saved)
+            }
+        }
+        return ;
+    }
+
+    gait_apply_preset(GAIT_ALL , PRESET_NORMAL);   // blank or invalid EEPROM
+}
+
+void gait_params_save()
+{
+    GaitEeprom saved ;
+    saved.magic = GAIT_EEPROM_MAGIC ;
+    saved.version = GAIT_EEPROM_VERSION ;
+    memcpy(saved.table , gait_table , sizeof(saved.table));
+    saved.crc = crc8((const uint8_t *)saved.table , sizeof(saved.table) , 0);
+    EEPROM.put(GAIT_EEPROM_ADDR , saved);     // put() uses update() so unchanged bytes don't wear the EEPROM
+}
+
+bool gait_slot_store(uint8_t start , uint8_t total , const uint8_t *data , uint8_t n)
+{
+    if (total == 0 || total > GAIT_SLOT_STEPS || start + n > total){return false ;}
+
+    if (start == 0)
+    {
+        gait_slot_count = 0 ;      // 'G' holds the legs until the whole table is loaded
+        gait_slot_next = 0 ;
+        gait_slot_total = total ;
+    }
+    else if (gait_slot_count != 0 || start != gait_slot_next || total != gait_slot_total)
+    {
+        return false ;             // after the table was complete , or a chunk before it was lost (CRC drop) :
+    }                              // the gap would still hold steps of an older table , the host must start again at 0
+
+    for (uint8_t i = 0 ; i < n ; i++ , data += 3)
+    {
+        GaitStep st ;
+        st.leg = data[0];
+        st.speed = (int8_t) data[1];
+        st.duration = data[2];
+        if (st.leg != STEP_NO_LEG && st.leg != RIGHT_LEG && st.leg != LEFT_LEG){return false ;}
+        if (st.speed < -100 || st.speed > 100 || st.duration == 0){return false ;}   // a 0 ms step would spin the refill
+        gait_slot[start + i] = st ;
+    }
+    gait_slot_next = start + n ;   // a bad step above leaves it behind , so the rest of this upload is rejected too
+
+    if (gait_slot_next == total)
+    {
+        gait_slot_count = total ;  // last chunk , the next refill runs it
+    }
+    return true ;
+}
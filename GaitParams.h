@@ -0,0 +1,50 @@
+#ifndef GAIT_PARAMS_H
+#define GAIT_PARAMS_H
+#include <stdint.h>
+#include "Robot.h"
+
+#define GAIT_ALL          0xFF   // gait id that addresses every entry of the table
+#define GAIT_MIN_MS       20     // timings outside this range are rejected
+#define GAIT_MAX_MS       5000
+#define GAIT_EEPROM_ADDR  0      // EEPROM address of the saved table
+#define GAIT_EEPROM_MAGIC 0x47   // 'G' , marks a table written by gait_params_save()
+#define GAIT_EEPROM_VERSION 1    // bump when the saved layout changes so old data is ignored
+#define GAIT_SLOT_STEPS   12     // steps of the RAM gait slot ('G' command) , loaded with OP_GAIT_STEPS
+
+enum GaitId {
+  GAIT_ID_FORWARD=0 ,   // 'F'
+  GAIT_ID_LEFT ,        // 'L'
+  GAIT_ID_RIGHT ,       // 'R'
+  GAIT_ID_COUNT } ; // entries of the gait parameter table
+
+enum GaitPreset {
+  PRESET_STABLE=0 ,     // long slow steps , best on slippery floors or with a low battery
+  PRESET_NORMAL ,       // the original 500 ms / 250 ms timing
+  PRESET_FAST ,         // short steps , most steps per second
+  PRESET_COUNT } ;
+
+struct GaitTiming {
+  uint16_t motion_ms ;  // how much time one servo moves per step
+  uint16_t stop_ms ;    // how much time to wait between steps
+} ;
+
+extern GaitTiming gait_table[GAIT_ID_COUNT];   // RAM copy used by move() and rotate() in the sketch
+
+void gait_params_load();       // reads the table from EEPROM , falls back to PRESET_NORMAL if nothing valid is saved
+void gait_params_save();       // writes the table to EEPROM (only changed bytes are written)
+bool gait_set_timing(uint8_t gait , uint16_t t_motion_delayms , uint16_t t_stop_delayms);   // gait = GaitId or GAIT_ALL
+                                                                       // returns false if a value is out of range
+bool gait_apply_preset(uint8_t gait , uint8_t preset);   // gait = GaitId or GAIT_ALL , preset = GaitPreset
+
+extern GaitStep gait_slot[GAIT_SLOT_STEPS];   // custom step table run by the 'G' command , RAM only (lost on reset)
+extern uint8_t gait_slot_count ;              // valid steps in gait_slot , 0 while empty or half loaded
+bool gait_slot_store(uint8_t start , uint8_t total , const uint8_t *data , uint8_t n);   /*- stores n steps (3 bytes each : leg , speed , duration)
+                                                                                         at index start of a table of total steps
+                                                                                       - start = 0 empties the slot , it becomes valid
+                                                                                         when the chunk that ends at total arrives
+                                                                                       - chunks must follow each other in order , one after a
+                                                                                         lost chunk is rejected and the slot stays empty
+                                                                                       - returns false for a bad index or step
+                                                                                       */
+
+#endif
@@ -3,41 +3,135 @@
 """  # Module docstring: explains what this script does.
 Face Tracking Robot Controller (PC-side)  # High-level description.
 
-This script detects a face in the camera feed, then sends ONE of these single-letter commands over serial:
+This script detects a face in the camera feed, then sends ONE of these movement commands over serial:
 - 'F' = face detected and centered enough -> move forward
 - 'L' = face detected and offset left -> turn left
 - 'R' = face detected and offset right -> turn right
 - 'S' = face detected but too close -> stop
 
+Every command carries a leg speed (percent): turns are scaled with the horizontal offset of the face,
+so a small error gives a small correction step instead of a full-speed rotate cycle.
+
 Special case:
 - If NO face is detected, it sends 'R' continuously (search by rotating right).
+- With several faces in view, the largest one is locked as the target and followed until it is lost,
+  even if another face becomes larger meanwhile (face_tracker.MultiFaceTracker).
 
 Important:
-- The Arduino side must be programmed to read these characters from Serial and act on them.
-- This script does not send any other commands besides F/L/R/S.
+- Commands travel in binary frames (sync, opcode, sequence number, CRC8) defined in robot_protocol.py.
+- Gait timing updates are batched with the next command into a single serial write.
+- Capture, detection and serial sending run on separate threads; each stage only works on the newest data,
+  so the robot reacts to the latest face position at the camera frame rate.
+- Commands are sent when they change; a low-rate heartbeat keeps the robot's command lease alive,
+  so the link load doesn't depend on the camera frame rate and the robot stops if this program freezes.
+- The firmware streams telemetry (the command it really executes, gait state, distance, obstacle stop);
+  a command stopped by an obstacle is not repeated while the stop holds, and resent as soon as it runs something else.
+- The camera is opened with an explicit backend, MJPG and a 1-frame driver buffer; frames the driver had
+  queued are grabbed and dropped, so detection works on what the camera sees now (camera_capture.py).
+- Starts unattended: the Arduino port is found by USB VID/PID (last good port first) without opening
+  candidate ports, and the firmware's ready frame replaces a fixed reset delay (serial_link.py, --interactive for prompts).
+- The preview (window, MJPEG over HTTP, or none when headless) is rendered at a capped rate,
+  so the control loop does not depend on display cost.
+- --trace stamps every command with the id of its camera frame; the firmware echoes it at the servo write and the
+  per-stage latency (capture, detect, decide, serial, firmware, actuation) is printed on exit or exported (latency_trace.py).
 """  # End of module docstring.
 
 import cv2  # type: ignore  # OpenCV: camera capture, drawing, and face detection (Pylance stubs may be incomplete).
+import numpy as np  # Preallocated detection buffer (numpy ships with OpenCV's Python package).
 import serial  # PySerial: used to talk to Arduino over USB serial.
 import time  # Used for delays and timeouts.
-from collections import deque  # Deque: fixed-length queue for smoothing face positions.
 import sys  # Used for sys.exit when a fatal error occurs.
+import threading  # Pipeline stages run on their own threads.
+import queue  # Bounded hand-off between pipeline stages.
+import argparse  # Command line options (preview mode).
+import json  # --config file.
+from robot_protocol import FrameEncoder, GAIT_ALL, PRESET_STABLE, PRESET_NORMAL, PRESET_FAST, SPEED_MAX  # Binary frames shared with the firmware.
+from robot_protocol import FrameDecoder, OP_STATS_SECTION, OP_STATS_COUNTERS, parse_stats_section, parse_stats_counters  # Replies.
+from robot_protocol import OP_TELEMETRY, parse_telemetry  # State streamed back by the firmware.
+from robot_protocol import OP_TRACE, TRACE_MIN_VERSION, parse_trace  # Traced commands reaching the servos.
+from robot_protocol import LEASE_MS  # Command lease (failsafe stop).
+from face_detectors import HaarDetector, DNN_TARGETS, create_detector  # Default detector backend (others live in face_detectors.py).
+from face_tracker import AlphaBetaTracker, MultiFaceTracker  # Predictive face filter, multi-face target lock.
+from preview_stream import MjpegStreamer  # Browser preview for robots without a monitor.
+from serial_link import find_arduino_ports, load_cached_port, save_cached_port, wait_ready  # Port discovery and handshake.
+from camera_capture import BACKENDS, open_camera, describe_camera, measure_capture_latency, FreshFrameReader  # Low-latency capture.
+from latency_trace import LatencyTracer  # Camera frame to servo write tracing.
+
+PREVIEW_MODES = ("window", "mjpeg", "none")  # OpenCV window, MJPEG over HTTP, headless.
+
+
+class LatestSlot:  # Single-item hand-off that always holds the newest value.
+    """Thread-safe slot: put() overwrites, wait_newer() takes the newest value (single consumer)"""  # Docstring.
+
+    def __init__(self):  # Constructor.
+        self.cond = threading.Condition()  # Protects value/version and wakes waiters.
+        self.value = None  # Newest value.
+        self.version = 0  # Incremented on every put().
+
+    def put(self, value):  # Publish a new value.
+        """Replace the value; returns the stale value nobody took (so its buffer can be reused), else None"""  # Docstring.
+        with self.cond:  # Exclusive access.
+            stale, self.value = self.value, value  # Overwrite.
+            self.version += 1  # New version.
+            self.cond.notify_all()  # Wake consumers.
+            return stale  # Dropped value, if any.
+
+    def wait_newer(self, seen_version, timeout=None):  # Get the next value.
+        """Return (value, version) newer than seen_version, or (None, seen_version) on timeout"""  # Docstring.
+        with self.cond:  # Exclusive access.
+            if not self.cond.wait_for(lambda: self.version != seen_version, timeout):  # Nothing new in time.
+                return None, seen_version  # Caller keeps its version.
+            value, self.value = self.value, None  # Taken: the consumer now owns it.
+            return value, self.version  # Newest value.
+
+
+def put_latest(q, item):  # Non-blocking put into a bounded queue.
+    """Put item into q, dropping the oldest entries instead of blocking when it is full"""  # Docstring.
+    while True:  # Retry until the item is queued.
+        try:  # Fast path.
+            q.put_nowait(item)  # Queue it.
+            return  # Done.
+        except queue.Full:  # Consumer is behind.
+            try:  # Make room.
+                q.get_nowait()  # Drop the stalest entry.
+            except queue.Empty:  # Consumer emptied it meanwhile.
+                pass  # Just retry.
 
 
 class FaceTrackingRobot:  # Main class that owns camera, detector, and Arduino link.
-    def __init__(self, arduino_port=None, camera_id=0):  # Constructor parameters: serial port and camera index.
+    def __init__(self, arduino_port=None, camera_id=0, detection_scale=0.5, detector=None,  # Port, camera, scale, backend.
+                 preview="window", preview_rate=5.0, mjpeg_port=8080,  # How (and how often) the preview is shown.
+                 record_path=None,  # Command stream recording for the firmware simulator.
+                 camera_backend="auto", camera_fourcc="MJPG", camera_fps=30, camera_buffers=1,  # Capture tuning.
+                 grab_discard=4, latency_test=True,  # Stale frame handling.
+                 trace=False, trace_csv=None, trace_chrome=None):  # Latency tracing.
         """  # Docstring for __init__.
         Initialize face tracking robot  # Create camera + optionally connect to Arduino.
         If arduino_port is None, runs in simulation mode  # Simulation prints commands instead of sending serial.
-        """  # End docstring.
+        detection_scale: detection runs on the frame resized by this factor (1.0 = full resolution)  # Speed knob.
+        detector: a face_detectors.FaceDetector backend (Haar cascade if None)  # Pluggable detector.
+        preview: "window", "mjpeg" (served on mjpeg_port) or "none" (headless, no GUI calls at all)  # Display.
+        preview_rate: maximum preview frames per second  # Display cost stays bounded.
+        record_path: if set, every command and gait change is written there as a sim/gait_bench scenario  # Replay.
+        camera_backend / camera_fourcc / camera_fps / camera_buffers: see camera_capture.open_camera()  # Capture.
+        grab_discard: stale frames skipped per read at most (0 = plain cap.read())  # Freshness.
+        latency_test: measure the driver's buffering at startup and print the capture latency  # Self-test.
+        trace: trace every command from its camera frame to the servo write, summary printed on exit  # Latency.
+        trace_csv / trace_chrome: export the traces there as CSV / Chrome trace JSON (implies trace)  # Analysis.
+                """  # End docstring.
         # Arduino connection  # Section header.
         self.arduino = None  # Will hold serial.Serial object when connected.
         self.simulation_mode = False  # Becomes True if no port or connect fails.
+        self.firmware_version = None  # PROTO_VERSION reported in OP_READY (None = no handshake).
 
         if arduino_port:  # If user provided a port string like "COM3".
             try:  # Try to open the serial connection.
-                self.arduino = serial.Serial(arduino_port, 115200, timeout=1)  # Open serial at 115200 baud.
-                time.sleep(2)  # Give Arduino time to reset after opening serial.
+                self.arduino = serial.Serial(arduino_port, 115200, timeout=0.1)  # Open serial at 115200 baud (resets the Arduino).
+                self.firmware_version = wait_ready(self.arduino)  # Waits for setup() to finish.
+                if self.firmware_version is None:  # No OP_READY from setup().
+                    print("⚠ No ready message from the Arduino (old firmware?), continuing anyway")  # Timed out instead.
+                else:  # Handshake done.
+                    save_cached_port(arduino_port)  # Tried first next time.
                 print(f"✓ Connected to Arduino on {arduino_port}")  # User feedback.
             except Exception as e:  # noqa: BLE001  # If opening serial fails (broad except to keep UX simple).
                 print(f"✗ Could not connect to Arduino: {e}")  # Show error.
@@ -48,25 +142,28 @@ class FaceTrackingRobot:  # Main class that owns camera, detector, and Arduino l
             self.simulation_mode = True  # Mark simulation mode.
 
         # Initialize camera  # Section header.
-        self.cap = cv2.VideoCapture(camera_id)  # Open camera device by index (0 is default webcam).
+        self.cap = open_camera(camera_id, camera_backend, camera_fourcc, 640, 480, camera_fps, camera_buffers)  # Low-latency settings.
         if not self.cap.isOpened():  # If OpenCV failed to open the camera.
             print("✗ Error: Could not open camera!")  # Print a clear error.
             sys.exit(1)  # Exit program with non-zero code.
-
-        # Set camera resolution  # Attempt to request resolution.
-        self.cap.set(cv2.CAP_PROP_FRAME_WIDTH, 640)  # Ask for width = 640 pixels.
-        self.cap.set(cv2.CAP_PROP_FRAME_HEIGHT, 480)  # Ask for height = 480 pixels.
-
-        # Load face detection model (Haar Cascade - built into OpenCV)  # Use classic Haar cascade.
-        self.face_cascade = cv2.CascadeClassifier(  # Create the classifier object.
-            cv2.data.haarcascades + 'haarcascade_frontalface_default.xml'  # Path to pre-trained face cascade.
-        )  # End CascadeClassifier creation.
-
-        if self.face_cascade.empty():  # If the classifier failed to load.
-            print("✗ Error: Could not load face detection model!")  # Print error.
-            sys.exit(1)  # Exit because face detection can't run.
-
-        print("✓ Face detection model loaded")  # Inform the user it's ready.
+        print(f"✓ Camera {camera_id} ({camera_backend}): {describe_camera(self.cap)}")  # What the driver accepted.
+        if latency_test:  # Startup self-measurement.
+            result = measure_capture_latency(self.cap)  # About a second.
+            if result:  # Camera delivered frames.
+                print(f"✓ Capture: {result['fps']:.1f} fps measured, {result['buffered']} buffered frames, "
+                      f"~{result['latency_ms']:.0f} ms old after a stall")  # Stale frames cost this much.
+        self.reader = FreshFrameReader(self.cap, camera_fps or 30, grab_discard)  # Skips frames the driver queued.
+
+        # Load face detection model (Haar Cascade - built into OpenCV - unless another backend is given)
+        if detector is None:  # Default backend.
+            try:  # The cascade file might be missing.
+                detector = HaarDetector()  # Original Haar cascade settings.
+            except RuntimeError:  # If the classifier failed to load.
+                print("✗ Error: Could not load face detection model!")  # Print error.
+                sys.exit(1)  # Exit because face detection can't run.
+        self.detector = detector  # Backend used by search_faces().
+
+        print(f"✓ Face detection model loaded ({self.detector.name})")  # Inform the user it's ready.
 
         # Tracking parameters  # Precomputed dimensions and centers.
         self.frame_width = 640  # Expected frame width (matches requested capture size).
@@ -78,6 +175,9 @@ class FaceTrackingRobot:  # Main class that owns camera, detector, and Arduino l
         self.dead_zone = 80  # Pixels near center where we don't turn.
         self.min_face_size = 15000  # Face area threshold: smaller means far away.
         self.max_face_size = 60000  # Face area threshold: larger means too close.
+        self.min_turn_speed = 30  # Leg speed (%) for an offset just outside the dead-zone.
+        self.search_speed = SPEED_MAX  # Leg speed (%) while searching for a face.
+        self.speed_resend_step = 10  # Resend the same command when its speed changes by at least this much.
 
         # Search parameters  # Bookkeeping only (we always return 'R' when no face).
         self.no_face_counter = 0  # Counts consecutive frames with no detected face.
@@ -85,75 +185,199 @@ class FaceTrackingRobot:  # Main class that owns camera, detector, and Arduino l
         self.last_face_time = time.time()  # Timestamp of last detection.
         self.search_timeout = 2.0  # Seconds without a face before searching.
 
-        # Face position history for smoothing  # Reduces jitter.
-        self.face_positions = deque(maxlen=5)  # Keep last 5 face measurements.
+        # Detection search window  # Track around the last face instead of scanning every frame fully.
+        if not 0 < detection_scale <= 1:  # Upscaling never helps, 0 would detect nothing.
+            raise ValueError(f"detection_scale must be in (0, 1], got {detection_scale!r}")  # Fail early.
+        self.detection_scale = detection_scale  # Detection image size relative to the camera frame.
+        self.small_buffer = None  # Detection resize output, sized for the full frame; every resize writes into a view of it.
+        self.min_detect_size = 80  # Smallest face searched in a full scan (pixels).
+        self.max_detect_size = 400  # Largest face searched in a full scan (pixels).
+        self.roi_padding = 0.5  # Window margin around the last face, as a fraction of its size.
+        self.roi_size_slack = 0.3  # Tracked faces may grow/shrink by this fraction between frames.
+        self.full_scan_interval = 10  # Force a full-frame scan at least every N frames (catches new faces).
+        self.frames_since_full_scan = 0  # Tracked frames since the last full scan.
+
+        # Target selection  # Several people in view: follow one of them until it is lost.
+        self.face_targets = MultiFaceTracker(iou_threshold=0.3, max_age=0.5, min_hits=2)  # Track ids + target lock.
+        self.target_id = None  # Track id the motion filter is following.
+
+        # Face tracking  # Smooths jitter without the lag of a moving average.
+        self.face_tracker = AlphaBetaTracker(alpha=0.6, beta=0.2, max_coast=0.5)  # Coasts through 0.5 s of dropouts.
+        self.control_latency = 0.15  # Seconds from decision to leg motion (serial + gait), predicted ahead.
 
         # Movement control  # State variables.
         self.movement_enabled = True  # Always True in this version (no keyboard toggle).
         self.last_command = None  # Last command sent, used to reduce spam.
-        self.command_count = 0  # Counter used to periodically resend command.
+        self.last_speed = None  # Speed of the last command sent.
+        self.command_speed = SPEED_MAX  # Speed chosen by calculate_movement_command() for its command.
+        self.last_decision_time = 0.0  # time.monotonic() of the newest decision from the detection stage.
+
+        # Serial protocol  # Frame encoder and batching.
+        self.encoder = FrameEncoder()  # Keeps the frame sequence number.
+        self.pending_frames = []  # Parameter frames waiting to go out with the next write.
+        self.decoder = FrameDecoder()  # Parses replies coming back from the Arduino.
+        self.frames_lock = threading.Lock()  # pending_frames is filled by the UI thread and sent by the sender thread.
+        self.last_send_time = 0.0  # time.monotonic() of the last write (command or heartbeat).
+        self.last_command_time = 0.0  # time.monotonic() of the last command write.
+
+        # Command lease  # Robot stops by itself if this program freezes.
+        self.lease_ms = LEASE_MS  # Firmware stops this long after the last command or heartbeat.
+        self.heartbeat_period = 0.15  # Seconds of silence before a heartbeat goes out (several per lease).
+        self.decision_periods = 3  # No heartbeat once detection missed this many of its own periods (frozen camera or detector)...
+        self.detect_period = 0.0  # ...smoothed time between two decisions, measured by the sender.
+        self.lease_armed = False  # First write carries a heartbeat that arms the lease.
+
+        # Robot telemetry  # Closed loop on what the firmware really does.
+        self.telemetry = None  # Newest parse_telemetry() record (None until one arrives).
+        self.telemetry_time = 0.0  # time.monotonic() when it arrived.
+        self.telemetry_timeout = 0.5  # Older records are ignored (old firmware, stalled link) -> open loop.
+        self.telemetry_settle = 0.1  # A new command shows up in the telemetry within this time.
+
+        # Latency tracing  # Where the time between a camera frame and the leg motion goes.
+        tracing = bool(trace or trace_csv or trace_chrome)  # Any trace option.
+        if tracing and self.arduino and (self.firmware_version or 0) < TRACE_MIN_VERSION:  # Firmware would ignore the trace ids.
+            print(f"⚠ Firmware protocol version {self.firmware_version or 'unknown'} doesn't answer traced commands "
+                  f"(needs {TRACE_MIN_VERSION}), latency tracing disabled")  # Instead of timing out every trace.
+            tracing = False  # Commands go out untraced.
+        self.tracer = LatencyTracer() if tracing else None  # None = commands carry no trace id.
+        self.trace_csv = trace_csv  # CSV export path.
+        self.trace_chrome = trace_chrome  # Chrome trace export path.
+
+        # Pipeline hand-offs  # Capture -> detect -> send, stale data is dropped at every stage.
+        self.latest_frame = LatestSlot()  # Freshest camera frame.
+        self.latest_result = LatestSlot()  # Freshest (frame, face_rect, command) for the UI.
+
+        # Reused buffers  # Avoids per-frame allocations (GC pauses / memory churn show up as command jitter).
+        self.frame_pool = queue.Queue()  # Camera frame buffers free for the next cap.read().
+        for _ in range(4):  # Enough for capture, latest slot, detection and UI at the same time.
+            self.frame_pool.put(None)  # Allocated by OpenCV on first use, reused afterwards.
+        self.preview_buffer = None  # Mirrored copy the overlays are drawn on.
+        self.render_overlay = True  # Draw the tracking overlay on the preview (False = plain mirrored frame).
+
+        # Preview  # Rendered at a capped rate off the control path.
+        if preview not in PREVIEW_MODES:  # Typo in the mode.
+            raise ValueError(f"preview must be one of {PREVIEW_MODES}, got {preview!r}")  # Fail early.
+        self.preview = preview  # Display mode.
+        self.preview_period = 1.0 / preview_rate if preview_rate > 0 else 0.0  # Minimum time between renders.
+        self.mjpeg_port = mjpeg_port  # HTTP port of the MJPEG stream.
+        self.streamer = None  # MjpegStreamer in "mjpeg" mode.
+
+        # Command recording  # Replayable through the firmware on the host (sim/bench.sh).
+        self.record_file = open(record_path, "w") if record_path else None  # Scenario file.
+        self.record_start = time.monotonic()  # Scenario time zero.
+        self.record_lock = threading.Lock()  # Sender and UI threads both record.
+        if self.record_file:  # Header for whoever opens it later.
+            self.record_file.write("# recorded by ObjectDetection.py\n")  # Comment line.
+        self.command_queue = queue.Queue(maxsize=1)  # Newest decision for the sender.
+        self.stop_event = threading.Event()  # Set to stop every stage.
 
         print("\n" + "="*50)  # Print a divider line.
         print("FACE TRACKING ROBOT CONTROLS")  # Title.
         print("="*50)  # Another divider.
         print("Commands sent: F / L / R / S only")  # Behavior summary.
         print("When NO FACE detected: sends 'R' (search right)")  # No-face behavior.
+        print("Press '1'/'2'/'3' for stable/normal/fast gait, 'w' to save it on the robot")  # Gait keys.
+        print("Press 'p' to print the robot's loop timing statistics")  # Stats key.
         print("Press 'q' to quit")  # Key hint.
         print("="*50 + "\n")  # Divider and spacing.
 
-    def detect_face(self, frame):  # Given a frame, try to find a face.
-        """Detect faces in frame using Haar Cascade"""  # Method docstring.
-        gray = cv2.cvtColor(frame, cv2.COLOR_BGR2GRAY)  # Convert BGR image to grayscale.
-
-        # Enhance contrast for better detection  # Helps Haar cascade on low-contrast images.
-        gray = cv2.equalizeHist(gray)  # Histogram equalization.
-
-        # Detect faces  # Return list of rectangles.
-        faces = self.face_cascade.detectMultiScale(  # Run multi-scale detection.
-            gray,  # Input image (grayscale).
-            scaleFactor=1.1,  # Step between scales; smaller = slower but more accurate.
-            minNeighbors=6,  # Higher = fewer false positives.
-            minSize=(80, 80),  # Ignore tiny detections.
-            maxSize=(400, 400),  # Ignore huge detections.
-            flags=cv2.CASCADE_SCALE_IMAGE  # Compatibility flag.
-        )  # End detectMultiScale.
-
-        if len(faces) == 0:  # If no faces detected.
-            return None  # Signal to caller that no face exists.
-
-        # Get the largest face  # Prefer the closest/most prominent face.
-        largest_face = max(faces, key=lambda rect: rect[2] * rect[3])  # Choose by area w*h.
-        x, y, w, h = largest_face  # Unpack rectangle.
-
-        return (x, y, w, h)  # Return bounding box.
-
-    def calculate_movement_command(self, face_rect):  # Decide what command to send.
-        """Calculate movement command based on face position"""  # Docstring.
+    def detect_face(self, frame, t=None):  # Given a frame, find the target face.
+        """Detect every face, keep their track ids and return the locked target's box (None if not seen this frame)
+
+        Searches around the target first, the full frame on a miss or every N frames."""  # Docstring.
+        t = time.monotonic() if t is None else t  # Capture time of the frame.
+        target = self.face_targets.target  # Locked face, if any.
+        if target is not None and self.frames_since_full_scan < self.full_scan_interval:  # Tracking mode.
+            x, y, w, h = target.rect  # Last box of the target.
+            pad_x = int(w * self.roi_padding)  # Horizontal margin for movement between frames.
+            pad_y = int(h * self.roi_padding)  # Vertical margin.
+            x0, y0 = max(0, x - pad_x), max(0, y - pad_y)  # Window top-left clipped to the frame.
+            x1 = min(frame.shape[1], x + w + pad_x)  # Window right edge clipped to the frame.
+            y1 = min(frame.shape[0], y + h + pad_y)  # Window bottom edge clipped to the frame.
+            size = max(w, h)  # Face size to look for.
+            min_size = max(self.min_detect_size, int(size * (1 - self.roi_size_slack)))  # Narrowed scale range...
+            max_size = min(self.max_detect_size, int(size * (1 + self.roi_size_slack)))  # ...around the last size.
+            faces = self.search_faces(frame[y0:y1, x0:x1], min_size, max_size)  # Search the window only.
+            faces = [(fx + x0, fy + y0, fw, fh) for fx, fy, fw, fh in faces]  # Back to frame coordinates.
+            self.frames_since_full_scan += 1  # Count tracked frames.
+            if self.face_targets.sees_target(faces):  # Found it near the previous position (decided before updating the tracks).
+                return self.follow_target(self.face_targets.update(faces, t, region=(x0, y0, x1, y1)))  # Other faces outside the window keep their tracks.
+
+        self.frames_since_full_scan = 0  # Full scan now (miss, first frame, or periodic refresh).
+        faces = self.search_faces(frame, self.min_detect_size, self.max_detect_size)  # Whole frame.
+        return self.follow_target(self.face_targets.update(faces, t))  # One update per frame; None if the target wasn't seen.
+
+    def follow_target(self, rect):  # Bookkeeping after the tracker update.
+        """Restart the motion filter when the tracker locked onto another face; pass rect through"""  # Docstring.
+        target_id = self.face_targets.target_id  # Current lock.
+        if target_id is not None and target_id != self.target_id:  # Another person (a lost target just coasts).
+            self.face_tracker.reset()  # Don't blend the old face's motion into the new one.
+            self.target_id = target_id  # Remember the lock.
+        return rect  # Same box.
+
+    @staticmethod
+    def mirror_rect(rect, width):  # Horizontal mirror in math instead of flipping pixels.
+        """Mirror a (x, y, w, h) box horizontally in an image of the given width (None stays None)"""  # Docstring.
+        if rect is None:  # No face.
+            return None  # Nothing to mirror.
+        x, y, w, h = rect  # Unpack.
+        return (width - x - w, y, w, h)  # Same box in the mirrored view.
+
+    def search_faces(self, image, min_size, max_size):  # Run the cascade on one image region.
+        """Return every face (x, y, w, h) in image with a size between min_size and max_size"""  # Docstring.
+        if min_size > max_size or image.shape[0] < min_size or image.shape[1] < min_size:  # Region can't hold such a face.
+            return []  # Nothing to search.
+
+        scale = self.detection_scale  # All detection work happens at this scale.
+        if scale != 1.0:  # Shrink first so grayscale, equalization and the cascade all run on fewer pixels.
+            size = (max(1, int(image.shape[1] * scale)), max(1, int(image.shape[0] * scale)))  # Target (width, height).
+            image = cv2.resize(image, size, dst=self.small_view(image, size), interpolation=cv2.INTER_AREA)  # Detect on the reduced image.
+        min_size = max(self.detector.min_face_size, int(min_size * scale))  # Size limits in detection pixels...
+        max_size = max(min_size, int(max_size * scale))  # ...but not below what the backend can see.
+
+        faces = self.detector.detect(image, min_size, max_size)  # Backend-specific detection (x, y, w, h, score).
+
+        return [(int(x / scale), int(y / scale), int(w / scale), int(h / scale)) for x, y, w, h in (f[:4] for f in faces)]  # Camera-frame coordinates, score unused.
+
+    def small_view(self, image, size):  # Destination of the detection resize.
+        """View of small_buffer with the (width, height) size of the resized image
+
+        The buffer is allocated once for the full frame at detection scale, so the ROI crops of tracking mode
+        (a new size almost every frame) never allocate; it only grows if a frame is larger than expected."""  # Docstring.
+        w, h = size  # Resized image size.
+        extra = image.shape[2:]  # Channels (none for grayscale).
+        buffer = self.small_buffer  # Current buffer.
+        if buffer is None or buffer.shape[0] < h or buffer.shape[1] < w or buffer.shape[2:] != extra or buffer.dtype != image.dtype:  # Too small.
+            full_w = max(w, int(self.frame_width * self.detection_scale) + 1)  # Full frame width at detection scale...
+            full_h = max(h, int(self.frame_height * self.detection_scale) + 1)  # ...and height, rounding included.
+            buffer = self.small_buffer = np.empty((full_h, full_w) + extra, dtype=image.dtype)  # Only allocation.
+        return buffer[:h, :w]  # Row-strided view, OpenCV writes into it in place.
+
+    def calculate_movement_command(self, face_rect, t=None):  # Decide what command to send.
+        """Calculate movement command based on the face position predicted for when the robot reacts"""  # Docstring.
+        t = time.monotonic() if t is None else t  # Capture time of the frame the detection came from.
         if face_rect is None:  # If we did not detect a face.
-            # No face detected — per request, continuously rotate RIGHT to search.
-            # This keeps the robot scanning until a face appears.
             self.no_face_counter += 1  # Increment missing-face frame count.
-            return 'R'  # Search by rotating right when no face is found.
-
-        # Reset counters when face is detected  # Face found again.
-        self.no_face_counter = 0  # Clear counter.
-        self.last_face_time = time.time()  # Update last-seen timestamp.
-
-        x, y, w, h = face_rect  # Unpack bounding box.
-        face_center_x = x + w // 2  # Compute face center x.
-        face_center_y = y + h // 2  # Compute face center y (currently not used in command).
-        face_area = w * h  # Compute face area (proxy for distance).
-
-        # Add to history for smoothing  # Keep last few measurements.
-        self.face_positions.append((face_center_x, face_center_y, face_area))  # Push tuple.
-
-        # Calculate average from history  # Smooth by simple mean.
-        if len(self.face_positions) > 0:  # If there is history (always true after append).
-            avg_x = int(sum(pos[0] for pos in self.face_positions) / len(self.face_positions))  # Mean x.
-            _avg_y = int(sum(pos[1] for pos in self.face_positions) / len(self.face_positions))  # Mean y (kept for completeness).
-            avg_area = int(sum(pos[2] for pos in self.face_positions) / len(self.face_positions))  # Mean area.
-        else:  # Defensive fallback.
-            avg_x, _avg_y, avg_area = face_center_x, face_center_y, face_area  # Use current values.
+            estimate = self.face_tracker.coast(t, self.control_latency)  # Keep following a briefly lost face.
+            if estimate is None:  # Track lost (or never started).
+                # No face detected — per request, continuously rotate RIGHT to search.
+                # This keeps the robot scanning until a face appears.
+                self.command_speed = self.search_speed  # Search at the configured speed.
+                return 'R'  # Search by rotating right when no face is found.
+        else:  # Face detected.
+            # Reset counters when face is detected  # Face found again.
+            self.no_face_counter = 0  # Clear counter.
+            self.last_face_time = time.time()  # Update last-seen timestamp.
+
+            x, y, w, h = face_rect  # Unpack bounding box.
+            face_center_x = x + w // 2  # Compute face center x.
+            face_center_y = y + h // 2  # Compute face center y (currently not used in command).
+            face_area = w * h  # Compute face area (proxy for distance).
+
+            self.face_tracker.update((face_center_x, face_center_y, face_area), t)  # O(1) filter update.
+            estimate = self.face_tracker.predict(t + self.control_latency)  # Where the face will be when the legs move.
+
+        avg_x, _avg_y, avg_area = (int(v) for v in estimate)  # Predicted center and area.
 
         # Calculate horizontal offset from center  # Left/right error for turning.
         offset_x = avg_x - self.center_x  # Positive means face is to the right.
@@ -162,27 +386,104 @@ class FaceTrackingRobot:  # Main class that owns camera, detector, and Arduino l
         # - If face is "too close" (area above max threshold) => Stop 'S'.
         # - Else, if face is left/right beyond dead-zone => Turn 'L' or 'R'.
         # - Else (face detected and roughly centered) => Move forward 'F'.
+        self.command_speed = SPEED_MAX  # Forward and stop run at full speed.
         if avg_area > self.max_face_size:  # Face too close → stop.
             return 'S'
         if abs(offset_x) >= self.dead_zone:  # Face not centered → turn toward it.
+            self.command_speed = self.turn_speed(abs(offset_x))  # Proportional heading correction.
             return 'L' if offset_x < 0 else 'R'
         return 'F'  # Face detected and centered enough → advance.
 
-    def send_to_arduino(self, command):  # Send command over serial or simulate.
-        """Send command to Arduino"""  # Docstring.
+    def turn_speed(self, error_x):  # Map the horizontal error to a leg speed.
+        """Leg speed (%) proportional to how far outside the dead-zone the face is"""  # Docstring.
+        span = max(1, self.center_x - self.dead_zone)  # Error range between dead-zone edge and frame edge.
+        ratio = min(1.0, (error_x - self.dead_zone) / span)  # 0 at the dead-zone edge, 1 at the frame edge.
+        return int(self.min_turn_speed + (SPEED_MAX - self.min_turn_speed) * ratio)  # Linear ramp.
+
+    def record(self, action):  # Append one scenario line.
+        """Write '<ms since start> <action>' to the recording (no-op without record_path)"""  # Docstring.
+        if not self.record_file:  # Not recording.
+            return  # Nothing to do.
+        with self.record_lock:  # Lines from two threads must not interleave.
+            self.record_file.write(f"{int((time.monotonic() - self.record_start) * 1000)} {action}\n")  # One event.
+
+    def queue_frame(self, frame_bytes):  # Add a parameter frame to the next write.
+        """Queue an encoded frame; it goes out together with the next command"""  # Docstring.
+        with self.frames_lock:  # Called from the UI thread.
+            self.pending_frames.append(frame_bytes)  # Batched until the next write.
+
+    def set_gait_timing(self, motion_ms, stop_ms, gait=GAIT_ALL):  # Queue a runtime gait timing change.
+        """Change move()/rotate() timings on the Arduino (sent with the next command)"""  # Docstring.
+        self.queue_frame(self.encoder.gait_timing(motion_ms, stop_ms, gait))  # Batched until the next write.
+        self.record(f"timing {'all' if gait == GAIT_ALL else gait} {motion_ms} {stop_ms}")  # Replayable.
+
+    def set_gait_preset(self, preset, gait=GAIT_ALL):  # Queue a speed preset change.
+        """Switch gaits to a speed preset on the Arduino (sent with the next command)"""  # Docstring.
+        self.queue_frame(self.encoder.gait_preset(preset, gait))  # Batched until the next write.
+        self.record(f"preset {preset}")  # Replayable (the simulator applies presets to every gait).
+
+    def save_gait_params(self):  # Queue an EEPROM save.
+        """Persist the Arduino's current gait table in its EEPROM"""  # Docstring.
+        self.queue_frame(self.encoder.gait_save())  # Batched until the next write.
+
+    def request_stats(self, reset=False):  # Ask the firmware for its profiling dump.
+        """Request loop timing statistics (printed by poll_arduino when they arrive)"""  # Docstring.
+        self.queue_frame(self.encoder.stats_request(reset))  # Batched until the next write.
+
+    def poll_arduino(self):  # Read replies without blocking.
+        """Handle whatever the Arduino has sent since the last call"""  # Docstring.
+        if self.simulation_mode or not self.arduino:  # Nothing to read.
+            return  # Done.
+        try:  # Serial read might fail.
+            waiting = self.arduino.in_waiting  # Bytes already received (never blocks).
+            if waiting == 0:  # Nothing new.
+                return  # Done.
+            frames = self.decoder.feed(self.arduino.read(waiting))  # Parse complete frames.
+            arrival = time.monotonic()  # Arrival time of the replies (trace clock sync).
+        except Exception as e:  # noqa: BLE001  # Keep the tracking loop running.
+            print(f"✗ Error reading from Arduino: {e}")  # Print why it failed.
+            return  # Done.
+        for opcode, _seq, payload in frames:  # Dispatch by opcode.
+            if opcode == OP_STATS_SECTION:  # One timing section.
+                name, st = parse_stats_section(payload)  # Decode.
+                print(f"[STATS] {name:12s} n={st['count']:<8d} min={st['min_us']}us avg={st['avg_us']}us max={st['max_us']}us")  # Print.
+            elif opcode == OP_STATS_COUNTERS:  # Event counters.
+                print(f"[STATS] counters {parse_stats_counters(payload)}")  # Print.
+            elif opcode == OP_TELEMETRY:  # Streamed robot state.
+                record = parse_telemetry(payload)  # Decode.
+                if record['obstacle'] and not (self.telemetry and self.telemetry['obstacle']):  # Forced stop just began.
+                    print(f"[ROBOT] obstacle at {record['distance_cm']} cm, stopped")  # Tell the user why it halted.
+                self.telemetry = record  # Newest state.
+                self.telemetry_time = time.monotonic()  # Freshness.
+            elif opcode == OP_TRACE and self.tracer:  # A traced command reached the servos.
+                self.tracer.complete(parse_trace(payload), arrival)  # Firmware stages.
+
+    def robot_state(self):  # Telemetry recent enough to act on.
+        """Newest telemetry record, or None if there is none from the last telemetry_timeout seconds"""  # Docstring.
+        if self.telemetry is None or time.monotonic() - self.telemetry_time > self.telemetry_timeout:  # Missing or stale.
+            return None  # Fall back to open loop.
+        return self.telemetry  # Fresh record.
+
+    def send_to_arduino(self, command, speed=SPEED_MAX, stamp=None):  # Send command over serial or simulate.
+        """Send command to Arduino; stamp (host times of its camera frame) starts a latency trace when tracing"""  # Docstring.
         allowed = {'F', 'L', 'R', 'S'}  # Only these commands are permitted to be sent.
         if command not in allowed:  # If command is outside allowed set, do nothing.
             return False  # Silently ignore disallowed commands.
+        self.record(f"cmd {command} {speed}")  # Same stream in real and simulation mode.
         if not self.simulation_mode and self.arduino and self.movement_enabled:  # Only send if real mode.
-            try:  # Serial write might fail.
-                self.arduino.write(command.encode())  # Convert string to bytes and send.
-                return True  # Report success.
-            except Exception as e:  # noqa: BLE001  # Handle serial errors (broad except keeps the loop running).
-                print(f"✗ Error sending to Arduino: {e}")  # Print why it failed.
-                return False  # Report failure.
+            traced = self.tracer is not None and stamp is not None  # Echoed by the firmware at the servo write.
+            trace_id = stamp['frame_id'] if traced else None  # Frame id as the trace id.
+            if not self.write_frames([self.encoder.command(command, speed, trace_id)]):  # Batched with queued parameters.
+                return False  # Write failed (already printed).
+            self.last_command_time = self.last_send_time  # Telemetry older than this can't reflect it yet.
+            if traced:  # Host stages are known now.
+                self.tracer.start(stamp, command, speed, self.last_send_time)  # Completed by OP_TRACE.
+            return True  # Report success.
         elif self.simulation_mode:  # In simulation we don't send serial.
             cmd_names = {'F': 'FORWARD', 'L': 'LEFT', 'R': 'RIGHT', 'S': 'STOP'}  # Human names (filtered to allowed).
-            print(f"[SIM] Command: {cmd_names.get(command, command)}")  # Print simulated movement.
+            print(f"[SIM] Command: {cmd_names.get(command, command)} ({speed}%)")  # Print simulated movement.
+            if self.tracer is not None and stamp is not None:  # No firmware to answer.
+                self.tracer.start(stamp, command, speed, time.monotonic(), expect_reply=False)  # Host stages only.
             return True  # Simulation always "succeeds".
         return False  # Movement disabled or missing serial connection.
 
@@ -232,6 +533,16 @@ class FaceTrackingRobot:  # Main class that owns camera, detector, and Arduino l
         mode_text = "SIMULATION" if self.simulation_mode else "ROBOT CONTROL"  # Display mode.
         cv2.putText(frame, f"Mode: {mode_text}", (10, 90), cv2.FONT_HERSHEY_SIMPLEX, 0.7, (255, 255, 0), 2)  # Draw mode.
 
+        robot = self.robot_state()  # Telemetry, if the firmware streams it.
+        if robot:  # Show what the robot really does next to what we ask for.
+            distance = "--" if robot['distance_cm'] is None else f"{robot['distance_cm']:.0f} cm"  # Nothing in range.
+            robot_color = (0, 0, 255) if robot['obstacle'] else (255, 255, 255)  # Red while an obstacle stops it.
+            cv2.putText(frame, f"Robot: {robot['cmd']} {robot['gait']} {distance}", (10, 150), cv2.FONT_HERSHEY_SIMPLEX, 0.5, robot_color, 1)  # Draw telemetry.
+
+        target = self.face_targets.target  # Locked face (read-only here, updated by the detection thread).
+        if target is not None:  # Show which of the faces is followed.
+            cv2.putText(frame, f"Target #{target.track_id} of {len(self.face_targets.tracks)} faces", (10, 175), cv2.FONT_HERSHEY_SIMPLEX, 0.5, (255, 255, 255), 1)  # Draw lock.
+
         if self.no_face_counter > 0:  # Only show if we have missed face frames.
             cv2.putText(frame, f"No face: {self.no_face_counter} frames", (10, 120), cv2.FONT_HERSHEY_SIMPLEX, 0.5, (0, 0, 255), 1)  # Draw count.
 
@@ -242,103 +553,334 @@ class FaceTrackingRobot:  # Main class that owns camera, detector, and Arduino l
     # manual_control_mode removed: per request we only send auto F/L/R/S based on detection.
 
     def run(self):  # Automatic tracking loop.
-        """Main tracking loop"""  # Docstring.
+        """Main tracking loop: capture, detection and serial run on their own threads; the preview is rate limited"""  # Docstring.
         print("Starting face tracking...")  # Startup message.
 
         # Per request: do NOT send initial STOP; start in passive state and only send F/L/R/S from detection.
 
-        while True:  # Main capture loop.
-            ret, frame = self.cap.read()  # Read one frame from camera.
-            if not ret:  # If reading failed.
-                print("✗ Error: Could not read frame!")  # Print error.
-                break  # Leave loop.
-
-            frame = cv2.flip(frame, 1)  # Mirror horizontally for user-friendly view.
-
-            face_rect = self.detect_face(frame)  # Detect face in current frame.
-
-            command = self.calculate_movement_command(face_rect)  # Decide movement command.
-
-            if command != self.last_command or self.command_count % 5 == 0:  # Reduce serial spam.
-                self.send_to_arduino(command)  # Send command.
-                self.last_command = command  # Remember last command.
-
-            self.command_count += 1  # Increment counter.
-
-            frame = self.draw_interface(frame, face_rect, command)  # Draw overlays.
-
-            cv2.imshow("Face Tracking Robot", frame)  # Show window.
+        workers = [  # Pipeline stages, each on its own thread.
+            threading.Thread(target=self.capture_loop, name="capture", daemon=True),  # Camera -> latest frame.
+            threading.Thread(target=self.detect_loop, name="detect", daemon=True),  # Latest frame -> command.
+            threading.Thread(target=self.send_loop, name="send", daemon=True),  # Command -> serial.
+        ]  # End worker list.
+        if self.preview == "mjpeg":  # Browser preview.
+            self.streamer = MjpegStreamer(self.mjpeg_port)  # HTTP server.
+            self.streamer.start()  # Accept viewers.
+            workers.append(threading.Thread(target=self.stream_loop, name="preview", daemon=True))  # Render + encode.
+        for worker in workers:  # Start every stage.
+            worker.start()  # Begin running.
+
+        try:  # Ctrl+C is the only way to quit without a window.
+            if self.preview == "window":  # HighGUI calls must stay on the main thread.
+                self.window_loop()  # Until 'q'.
+            else:  # Headless or MJPEG: nothing to do here.
+                print("Press Ctrl+C to stop")  # No window to press 'q' in.
+                while not self.stop_event.wait(0.5):  # Until a stage fails.
+                    pass  # Sleep.
+        except KeyboardInterrupt:  # Ctrl+C.
+            print("\nShutting down...")  # Tell user.
+
+        self.stop_event.set()  # Tell every stage to finish.
+        for worker in workers:  # Wait for the stages.
+            worker.join(timeout=1.0)  # Bounded wait so a stuck camera can't hang shutdown.
+        self.cleanup()  # Cleanup resources.
 
-            key = cv2.waitKey(1) & 0xFF  # Read key.
+    def render_preview(self, result):  # Turn one detection result into a preview image.
+        """Mirror the frame into the preview buffer, release the camera buffer and draw the overlay"""  # Docstring.
+        frame, face_rect, command = result  # Unpack the detection output.
+        self.preview_buffer = cv2.flip(frame, 1, dst=self.preview_buffer)  # Mirrored view, reused buffer.
+        self.release_frame(frame)  # Camera buffer can be captured into again.
+        if self.render_overlay:  # Overlay is optional.
+            self.draw_interface(self.preview_buffer, face_rect, command)  # Draw overlays in place.
+        return self.preview_buffer  # Ready to show or encode.
+
+    def window_loop(self):  # Main thread in "window" mode.
+        """Show the newest result at most preview_rate times per second and handle keys"""  # Docstring.
+        shown_version = 0  # Version of the last displayed result.
+        next_render = 0.0  # Earliest time of the next render.
+        while not self.stop_event.is_set():  # UI loop.
+            if time.monotonic() >= next_render:  # Render due.
+                result, shown_version = self.latest_result.wait_newer(shown_version, timeout=0)  # Newest result, if any.
+                if result is not None:  # Something new to show.
+                    next_render = time.monotonic() + self.preview_period  # Cap the display rate.
+                    cv2.imshow("Face Tracking Robot", self.render_preview(result))  # Show window.
+
+            key = cv2.waitKey(20) & 0xFF  # Read key (also pumps window events between renders).
 
             if key == ord('q'):  # Quit.
                 print("\nShutting down...")  # Tell user.
                 break  # Exit loop.
-            # Per request: only support quitting; no toggles or extra commands.
-
-        self.cleanup()  # Cleanup resources.
+            gait_keys = {ord('1'): PRESET_STABLE, ord('2'): PRESET_NORMAL, ord('3'): PRESET_FAST}  # Live gait presets.
+            if key in gait_keys:  # Trade speed against stability without reflashing.
+                self.set_gait_preset(gait_keys[key])  # Goes out with the next command.
+            elif key == ord('w'):  # Keep the current gait after a power cycle.
+                self.save_gait_params()  # Goes out with the next command.
+            elif key == ord('p'):  # Profile the firmware on the device.
+                self.request_stats()  # Goes out with the next command.
+
+    def stream_loop(self):  # Preview thread in "mjpeg" mode.
+        """Encode the newest result as JPEG at most preview_rate times per second"""  # Docstring.
+        shown_version = 0  # Version of the last streamed result.
+        while not self.stop_event.is_set():  # Until shutdown.
+            result, shown_version = self.latest_result.wait_newer(shown_version, timeout=0.1)  # Newest result.
+            if result is None:  # Timed out, check for shutdown.
+                continue  # Wait again.
+            ok, jpeg = cv2.imencode(".jpg", self.render_preview(result), [cv2.IMWRITE_JPEG_QUALITY, 70])  # Compress.
+            if ok:  # Encoding worked.
+                self.streamer.publish(jpeg.tobytes())  # Viewers get it on their own threads.
+            self.stop_event.wait(self.preview_period)  # Cap the stream rate (results meanwhile are recycled).
+
+    def release_frame(self, frame):  # Return a camera buffer to the pool.
+        """Make a frame buffer available to the capture stage again"""  # Docstring.
+        self.frame_pool.put(frame)  # Reused by the next cap.read().
+
+    def capture_loop(self):  # Stage 1: keep the freshest camera frame.
+        """Read frames as fast as the camera delivers them; older unprocessed frames are overwritten"""  # Docstring.
+        while not self.stop_event.is_set():  # Until shutdown.
+            try:  # Wait for a free buffer.
+                buffer = self.frame_pool.get(timeout=0.1)  # A buffer no other stage is using.
+            except queue.Empty:  # Every buffer busy (UI or detection stalled).
+                continue  # Check for shutdown and retry.
+            read_start = time.monotonic()  # Start of the capture stage.
+            ret, frame = self.reader.read(buffer)  # Freshest frame, decoded in place.
+            if not ret:  # If reading failed.
+                print("✗ Error: Could not read frame!")  # Print error.
+                self.stop_event.set()  # Stop the whole pipeline.
+                break  # Leave loop.
+            frame_id = self.tracer.next_id() if self.tracer else 0  # Correlates the command with this frame.
+            stale = self.latest_frame.put((frame, time.monotonic(), read_start, frame_id))  # Replace any frame detection hasn't taken yet.
+            if stale is not None:  # Detection skipped that frame.
+                self.release_frame(stale[0])  # Recycle its buffer.
+
+    def detect_loop(self):  # Stage 2: detection and decision.
+        """Detect on the newest frame only and hand the command to the sender"""  # Docstring.
+        version = 0  # Version of the last processed frame.
+        while not self.stop_event.is_set():  # Until shutdown.
+            item, version = self.latest_frame.wait_newer(version, timeout=0.1)  # Skip frames that arrived meanwhile.
+            if item is None:  # Timed out, check for shutdown.
+                continue  # Wait again.
+            frame, capture_time, read_start, frame_id = item  # Frame, when it was captured and its trace id.
+
+            raw_rect = self.detect_face(frame, capture_time)  # Detect face in the camera image (not flipped, saves a copy).
+            detect_done = time.monotonic()  # End of the detect stage.
+            face_rect = self.mirror_rect(raw_rect, frame.shape[1])  # Mirrored coordinates, as in the user-friendly view.
+
+            command = self.calculate_movement_command(face_rect, capture_time)  # Decide movement command.
+
+            stamp = {'frame_id': frame_id, 'read_start': read_start, 'capture_time': capture_time,  # Host times of the frame...
+                     'detect_done': detect_done} if self.tracer else None  # ...for the latency trace.
+            put_latest(self.command_queue, (command, self.command_speed, stamp))  # Sender always gets the newest decision.
+            if self.preview == "none":  # Headless: nobody looks at the frame.
+                self.release_frame(frame)  # Recycle right away.
+                continue  # Next frame.
+            stale = self.latest_result.put((frame, face_rect, command))  # Preview shows the newest result.
+            if stale is not None:  # Preview skipped that result.
+                self.release_frame(stale[0])  # Recycle its buffer.
+
+    def send_loop(self):  # Stage 3: serial link.
+        """Send decisions to the Arduino when they change, keep the lease alive and read its replies"""  # Docstring.
+        while not self.stop_event.is_set():  # Until shutdown.
+            try:  # Wait briefly so replies are polled and heartbeats sent even without new decisions.
+                command, speed, stamp = self.command_queue.get(timeout=0.05)  # Newest decision.
+                now = time.monotonic()  # Arrival of the decision.
+                if self.last_decision_time:  # Not the first one: measure the detection period.
+                    period = now - self.last_decision_time  # Camera frame time plus detection cost.
+                    self.detect_period = period if not self.detect_period else 0.8 * self.detect_period + 0.2 * period  # Smoothed.
+                self.last_decision_time = now  # Detection is alive.
+                self.handle_decision(command, speed, stamp)  # Send it if the robot needs it.
+            except queue.Empty:  # No decision in time.
+                pass  # Heartbeat and replies only.
+            self.keepalive()  # Renew the lease if the link was quiet.
+            self.poll_arduino()  # Telemetry and statistics from the robot.
+
+    def handle_decision(self, command, speed, stamp=None):  # Deduplicate one decision.
+        """Send command only if it differs from what was sent, or from what the robot reports doing
+
+        Without fresh telemetry (turned off, old firmware, stalled link) the robot can't report an obstacle stop that
+        has cleared, so the command is resent every telemetry_timeout instead."""  # Docstring.
+        robot = self.robot_state()  # What the firmware reports it is doing (None without telemetry).
+        if robot and robot['obstacle'] and command != 'S' and command == self.last_command:  # This command was stopped by an obstacle.
+            return  # Don't repeat it; the mismatch below resends once its path is clear (other commands may be free to run).
+
+        speed_changed = self.last_speed is None or abs(speed - self.last_speed) >= self.speed_resend_step  # Worth resending?
+        settled = robot is not None and self.telemetry_time - self.last_command_time > self.telemetry_settle  # Record postdates the send.
+        ignored = settled and (robot['cmd'] != self.last_command or robot['speed'] != self.last_speed)  # Lost frame, forced stop or lease over.
+        blind = (robot is None and not self.simulation_mode  # No closed loop: the firmware keeps 'S' after an obstacle...
+                 and time.monotonic() - self.last_command_time > self.telemetry_timeout)  # ...until the host sends again.
+        if command != self.last_command or speed_changed or ignored or blind:  # Identical repeats are only sent without telemetry.
+            self.send_to_arduino(command, speed, stamp)  # Send command (traced with its frame's stamp).
+            self.last_command = command  # Remember last command.
+            self.last_speed = speed  # Remember last speed.
+
+    def keepalive(self):  # Heartbeat of the command lease.
+        """Send a heartbeat (with any queued parameter frames) when nothing was written for heartbeat_period"""  # Docstring.
+        if self.simulation_mode or not self.arduino or not self.movement_enabled:  # No link, no lease.
+            return  # Done.
+        now = time.monotonic()  # Current time.
+        if now - self.last_send_time < self.heartbeat_period:  # A recent write already renewed the lease.
+            return  # Done.
+        if now - self.last_decision_time > self.decision_timeout():  # Detection is stuck: let the lease run out.
+            return  # The robot stops by itself.
+        self.write_frames([self.encoder.heartbeat(self.lease_ms)])  # Renew.
+
+    def decision_timeout(self):  # When detection counts as stuck.
+        """Seconds without a decision before the heartbeats stop
+
+        Never shorter than the lease, and a few detection periods for slow backends (DNN detectors on a Pi),
+        so a healthy but slow detector doesn't let the lease lapse between two decisions."""  # Docstring.
+        return max(self.lease_ms / 1000.0, self.decision_periods * self.detect_period)  # Seconds.
+
+    def write_frames(self, frames):  # One serial write for a batch.
+        """Write queued parameter frames followed by frames; True on success"""  # Docstring.
+        with self.frames_lock:  # Take the queued parameter frames.
+            batch, self.pending_frames = self.pending_frames, []  # Swap so the UI can keep queueing.
+        if not self.lease_armed:  # First write of the session.
+            batch.insert(0, self.encoder.heartbeat(self.lease_ms))  # Arms the lease before the first command.
+        try:  # Serial write might fail.
+            self.arduino.write(b''.join(batch + frames))  # Parameters first, then the new frames.
+        except Exception as e:  # noqa: BLE001  # Handle serial errors (broad except keeps the loop running).
+            print(f"✗ Error sending to Arduino: {e}")  # Print why it failed.
+            return False  # Report failure.
+        self.lease_armed = True  # Robot now expects renewals.
+        self.last_send_time = time.monotonic()  # Telemetry older than this can't reflect it yet.
+        return True  # Report success.
 
     def cleanup(self):  # Clean up camera and serial.
         """Cleanup resources"""  # Docstring.
         print("\nCleaning up...")  # Notify user.
 
         if not self.simulation_mode and self.arduino:  # If we have a real Arduino connection.
-            self.arduino.write(b'S')  # Send a final STOP before closing (safety on exit).
+            self.arduino.write(self.encoder.command('S'))  # Send a final STOP before closing (safety on exit).
             time.sleep(0.1)  # Give it time.
             self.arduino.close()  # Close serial port.
 
+        if self.streamer:  # MJPEG preview running.
+            self.streamer.stop()  # Disconnect viewers, free the port.
         self.cap.release()  # Release camera.
-        cv2.destroyAllWindows()  # Close OpenCV windows.
+        if self.record_file:  # Recording open.
+            self.record_file.close()  # Flush the scenario.
+        if self.tracer:  # Latency tracing on.
+            for line in self.tracer.summary():  # Per-stage histogram, biggest stage first.
+                print(line)  # Report.
+            if self.trace_csv:  # One row per trace.
+                self.tracer.export_csv(self.trace_csv)  # Spreadsheet.
+                print(f"✓ Latency traces written to {self.trace_csv}")  # Where.
+            if self.trace_chrome:  # Timeline view.
+                self.tracer.export_chrome(self.trace_chrome)  # chrome://tracing / Perfetto.
+                print(f"✓ Chrome trace written to {self.trace_chrome}")  # Where.
+        if self.preview == "window":  # Headless OpenCV builds have no HighGUI at all.
+            cv2.destroyAllWindows()  # Close OpenCV windows.
 
         print("✓ Cleanup complete")  # Done.
         print("Goodbye!")  # Final message.
 
 
-def find_arduino_port():  # Helper to guess Arduino port.
-    """Try to automatically find Arduino port"""  # Docstring.
-    # Detect common Arduino ports on Windows
-    ports = [f"COM{i}" for i in range(1, 10)]  # Try COM1..COM9.
-    for port in ports:  # Try each candidate.
-        try:  # Opening might fail.
-            ser = serial.Serial(port, 115200, timeout=1)  # Attempt to open.
-            ser.close()  # Close immediately if successful.
-            return port  # Return the first working port.
-        except Exception:  # Ignore and keep trying other ports.
-            continue  # Next port.
-
-    return None  # No port detected.
+def choose_arduino_port(port_arg, interactive):  # Resolve --port.
+    """Port name to use, or None for simulation; only asks questions in interactive mode"""  # Docstring.
+    if port_arg.lower() == "none":  # Explicit simulation.
+        return None  # No robot.
+    if port_arg.lower() != "auto":  # Explicit port name.
+        return port_arg  # Use as given.
+
+    candidates = find_arduino_ports(load_cached_port())  # VID/PID match, cached port first, nothing opened.
+    if not interactive:  # Unattended start.
+        if candidates:  # Something looks like an Arduino.
+            print(f"Using Arduino on {candidates[0][0]} ({candidates[0][1]})")  # Inform user.
+            return candidates[0][0]  # Best guess.
+        print("No Arduino found, running in simulation mode")  # Inform user.
+        return None  # Simulation.
+
+    if candidates:  # Confirm the guess.
+        port, description = candidates[0]  # Best guess.
+        print(f"Auto-detected Arduino on: {port} ({description})")  # Inform user.
+        if input("Use this port? (y/n): ").lower().strip() == 'y':  # Confirmed.
+            return port  # Use it.
+    else:  # Nothing auto-detected.
+        print("Could not auto-detect Arduino")  # Inform user.
+    port = input("Enter Arduino port (or press Enter for simulation): ").strip()  # Ask for manual port.
+    return port or None  # Empty -> simulation.
 
 
 def main():  # Script entry point.
     """Main function"""  # Docstring.
+    parser = argparse.ArgumentParser(description="Face tracking robot controller")  # Options for deployed units.
+    parser.add_argument("--config", metavar="FILE", help="JSON file with defaults for any option below (e.g. {\"port\": \"COM3\"})")  # Unattended setups.
+    parser.add_argument("--port", default="auto", help="Arduino serial port, 'auto' (USB VID/PID, cached port first) or 'none'")  # Link.
+    parser.add_argument("--camera", type=int, default=0, help="camera index")  # Camera.
+    parser.add_argument("--interactive", action="store_true", help="confirm the port and camera at the prompt")  # Old behaviour.
+    parser.add_argument("--preview", choices=PREVIEW_MODES, default="window",  # Display mode.
+                        help="window, mjpeg (browser stream) or none")  # Help text.
+    parser.add_argument("--headless", action="store_true", help="same as --preview none")  # Short form.
+    parser.add_argument("--preview-rate", type=float, default=5.0, help="max preview frames per second")  # Display cost.
+    parser.add_argument("--mjpeg-port", type=int, default=8080, help="HTTP port of the MJPEG preview")  # Stream port.
+    parser.add_argument("--record", metavar="FILE", help="record commands as a sim/gait_bench scenario")  # Replay.
+    parser.add_argument("--camera-backend", choices=tuple(BACKENDS), default="auto", help="OpenCV capture API")  # V4L2/DSHOW/MSMF.
+    parser.add_argument("--fourcc", default="MJPG", help="camera pixel format, 'none' keeps the driver default")  # MJPG.
+    parser.add_argument("--fps", type=int, default=30, help="requested camera frame rate (0 = driver default)")  # Frame period.
+    parser.add_argument("--buffer-size", type=int, default=1, help="driver frame buffers (0 = driver default)")  # Queue depth.
+    parser.add_argument("--grab-discard", type=int, default=4, help="stale frames skipped per read at most")  # Freshness.
+    parser.add_argument("--no-latency-test", action="store_true", help="skip the startup capture latency test")  # Faster start.
+    parser.add_argument("--detector", choices=("haar", "yunet", "ssd", "hybrid"), default="haar",  # Backend.
+                        help="face detector backend (compare them with face_detectors.py --video)")  # Help text.
+    parser.add_argument("--yunet-model", metavar="FILE", help="face_detection_yunet_*.onnx (yunet, hybrid)")  # YuNet model.
+    parser.add_argument("--ssd-prototxt", metavar="FILE", help="deploy.prototxt (ssd, hybrid without --yunet-model)")  # SSD graph.
+    parser.add_argument("--ssd-model", metavar="FILE", help="res10_300x300_ssd_iter_140000.caffemodel")  # SSD weights.
+    parser.add_argument("--dnn-target", choices=sorted(DNN_TARGETS), default="cpu", help="compute device of the DNN backends")  # Device.
+    parser.add_argument("--detection-scale", type=float, default=0.5,  # Detection cost.
+                        help="detection image size relative to the camera frame, 0 < s <= 1 (lower for Pi-class boards)")  # Help text.
+    parser.add_argument("--trace", action="store_true", help="trace commands from camera frame to servo write, summary on exit")  # Latency.
+    parser.add_argument("--trace-csv", metavar="FILE", help="write the latency traces as CSV (implies --trace)")  # Export.
+    parser.add_argument("--trace-chrome", metavar="FILE", help="write the latency traces as a Chrome trace (implies --trace)")  # Export.
+    config_args, _ = parser.parse_known_args()  # Only --config matters in this pass.
+    if config_args.config:  # Config file values become the defaults, the command line still wins.
+        with open(config_args.config) as f:  # Small JSON object.
+            parser.set_defaults(**{key.replace("-", "_"): value for key, value in json.load(f).items()})  # Same names as the options.
+    args = parser.parse_args()  # Parse sys.argv.
+    if args.headless:  # Headless wins.
+        args.preview = "none"  # No GUI calls at all.
+    if not 0 < args.detection_scale <= 1:  # Checked here so --config values are covered too.
+        parser.error(f"--detection-scale must be in (0, 1], got {args.detection_scale}")  # Exits with usage.
+    ssd_files = bool(args.ssd_prototxt and args.ssd_model)  # Both SSD files given.
+    model_needs = {  # Backend -> (model files given, options it needs).
+        "yunet": (bool(args.yunet_model), "--yunet-model"),  # onnx model.
+        "ssd": (ssd_files, "--ssd-prototxt and --ssd-model"),  # Caffe files.
+        "hybrid": (bool(args.yunet_model) or ssd_files, "--yunet-model or --ssd-prototxt and --ssd-model"),  # Either confirmer.
+    }  # Haar needs nothing.
+    if args.detector in model_needs and not model_needs[args.detector][0]:  # Model files missing.
+        parser.error(f"--detector {args.detector} needs {model_needs[args.detector][1]}")  # Exits with usage.
+
     print("="*60)  # Divider.
     print("FACE TRACKING ROBOT")  # Title.
     print("Sends only: F / L / R / S")  # Behavior reminder.
     print("No face: sends 'R' (search right)")  # Behavior reminder.
     print("="*60)  # Divider.
 
-    arduino_port = find_arduino_port()  # Try to auto-detect Arduino port.
-
-    if arduino_port:  # If we found something.
-        print(f"Auto-detected Arduino on: {arduino_port}")  # Inform user.
-        use_port = input(f"Use this port? (y/n): ").lower().strip()  # Ask for confirmation.
-        if use_port != 'y':  # If user says no.
-            arduino_port = input("Enter Arduino port (or press Enter for simulation): ").strip()  # Ask for manual port.
-            if arduino_port == "":  # If user pressed Enter.
-                arduino_port = None  # Use simulation.
-    else:  # Nothing auto-detected.
-        print("Could not auto-detect Arduino")  # Inform user.
-        arduino_port = input("Enter Arduino port (or press Enter for simulation): ").strip()  # Ask.
-        if arduino_port == "":  # If empty.
-            arduino_port = None  # Use simulation.
-
-    camera_id = input("Enter camera ID (0 for default, 1 for external): ").strip()  # Ask user for camera index.
-    try:  # Conversion might fail.
-        camera_id = int(camera_id)  # Convert to int.
-    except Exception:  # If user typed non-number.
-        camera_id = 0  # Default to 0.
-
-    robot = FaceTrackingRobot(arduino_port=arduino_port, camera_id=camera_id)  # Create the controller.
+    arduino_port = choose_arduino_port(args.port, args.interactive)  # No port is opened to find it.
+
+    detector = None  # Haar cascade, loaded by the constructor.
+    if args.detector != "haar":  # DNN backend.
+        try:  # Model files may be unreadable, or the target missing from this OpenCV build.
+            detector = create_detector(args.detector, args.yunet_model, args.ssd_prototxt, args.ssd_model, args.dnn_target)  # Build.
+        except (cv2.error, AttributeError) as e:  # AttributeError: cv2.FaceDetectorYN needs OpenCV >= 4.5.4.
+            print(f"✗ Error: Could not load the {args.detector} detector: {e}")  # Print why.
+            sys.exit(1)  # Don't silently fall back to a slower or weaker backend.
+
+    camera_id = args.camera  # Camera index.
+    if args.interactive:  # Old prompt.
+        try:  # Conversion might fail.
+            camera_id = int(input(f"Enter camera ID (0 for default, 1 for external) [{camera_id}]: ").strip() or camera_id)  # Ask.
+        except ValueError:  # If user typed non-number.
+            pass  # Keep the default.
+
+    robot = FaceTrackingRobot(arduino_port=arduino_port, camera_id=camera_id, preview=args.preview,  # Create the controller.
+                              detection_scale=args.detection_scale, detector=detector,  # Detection image size and backend.
+                              preview_rate=args.preview_rate, mjpeg_port=args.mjpeg_port,  # Preview options.
+                              record_path=args.record,  # Command recording.
+                              camera_backend=args.camera_backend,  # Capture API.
+                              camera_fourcc=None if args.fourcc.lower() == "none" else args.fourcc,  # Pixel format.
+                              camera_fps=args.fps, camera_buffers=args.buffer_size,  # Frame rate and queue depth.
+                              grab_discard=args.grab_discard, latency_test=not args.no_latency_test,  # Freshness.
+                              trace=args.trace, trace_csv=args.trace_csv, trace_chrome=args.trace_chrome)  # Latency tracing.
     robot.run()  # Run until user quits.
 
 
@@ -0,0 +1,18 @@
+#include "Power.h"
+#include <Arduino.h>
+#include <avr/sleep.h>
+
+void power_idle_sleep()
+{
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    noInterrupts();
+    if (Serial.available())        // a byte arrived after the caller checked , don't sleep on it
+    {
+        interrupts();
+        return ;
+    }
+    sleep_enable();
+    interrupts();                  // the instruction after sei always runs , so an interrupt pending here still wakes sleep_cpu()
+    sleep_cpu();
+    sleep_disable();
+}
@@ -0,0 +1,14 @@
+#ifndef POWER_H
+#define POWER_H
+#include <stdint.h>
+
+#define POWER_IDLE_DELAY_MS 500    // stopped this long (no queued servo events) before the legs are released and the MCU naps
+                                   // short pauses between commands keep the servos attached
+
+void power_idle_sleep();     /* one SLEEP_MODE_IDLE nap , the CPU clock stops but every peripheral keeps running
+                                - woken by any interrupt : UART RX , the millis() timer (about every 1 ms) , the echo pin change
+                                - returns right away if serial data is already waiting
+                                - call it from loop() only while idle , the loop then runs about once per timer tick
+                             */
+
+#endif
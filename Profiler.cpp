@@ -0,0 +1,76 @@
+#include "Profiler.h"
+#include "Protocol.h"
+#include <Arduino.h>
+
+static ProfStat prof_stats[PROF_SECTION_COUNT];
+static uint16_t prof_counters[PROF_COUNTER_COUNT];
+
+
+void prof_reset()
+{
+    for (uint8_t i = 0 ; i < PROF_SECTION_COUNT ; i++)
+    {
+        prof_stats[i].count = 0 ;
+        prof_stats[i].sum_us = 0 ;
+        prof_stats[i].min_us = 0xFFFF ;
+        prof_stats[i].max_us = 0 ;
+    }
+    for (uint8_t i = 0 ; i < PROF_COUNTER_COUNT ; i++)
+    {
+        prof_counters[i] = 0 ;
+    }
+}
+
+void prof_record(uint8_t section , unsigned long duration_us)
+{
+    if (section >= PROF_SECTION_COUNT){return ;}
+
+    uint16_t d = (duration_us > 0xFFFF) ? 0xFFFF : duration_us ;
+    ProfStat &st = prof_stats[section];
+    if (st.count == 0)             // first sample after a reset (static storage starts at zero)
+    {
+        st.min_us = d ;
+        st.max_us = d ;
+    }
+    if (d < st.min_us){st.min_us = d ;}
+    if (d > st.max_us){st.max_us = d ;}
+    if (st.sum_us > 0xFFFFFFFFUL - d)   // halve both before the sum overflows (about 70 minutes of loop time)
+    {                                    // the average stays right , count is then the number of samples in it
+        st.sum_us >>= 1 ;
+        st.count >>= 1 ;
+    }
+    st.sum_us += d ;
+    st.count++ ;
+}
+
+void prof_count(uint8_t counter)
+{
+    if (counter < PROF_COUNTER_COUNT && prof_counters[counter] != 0xFFFF)   // saturate instead of wrapping to 0
+    {
+        prof_counters[counter]++ ;
+    }
+}
+
+void prof_send_stats()
+{
+    uint8_t buf[2 * PROF_COUNTER_COUNT > 11 ? 2 * PROF_COUNTER_COUNT : 11];
+
+    for (uint8_t i = 0 ; i < PROF_SECTION_COUNT ; i++)
+    {
+        const ProfStat &st = prof_stats[i];
+        uint8_t *p = buf ;
+        *p++ = i ;
+        p = proto_put_u32(p , st.count);
+        p = proto_put_u16(p , st.count ? st.min_us : 0);
+        p = proto_put_u16(p , st.count ? st.sum_us / st.count : 0);
+        p = proto_put_u16(p , st.max_us);
+        protocol_send(OP_STATS_SECTION , buf , p - buf);
+    }
+
+    uint8_t *p = buf ;
+    for (uint8_t i = 0 ; i < PROF_COUNTER_COUNT ; i++)
+    {
+        p = proto_put_u16(p , prof_counters[i]);
+    }
+    protocol_send(OP_STATS_COUNTERS , buf , p - buf);
+}
@@ -0,0 +1,51 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+#include <stdint.h>
+
+#ifndef ROBOT_PROFILING
+#define ROBOT_PROFILING 1    // 1 -> loop sections are timed (a few micros() calls per loop) , 0 -> compiled out
+#endif
+
+enum ProfSection {
+  PROF_SERIAL=0 ,        // protocol_poll()
+  PROF_RANGING ,         // ultrasonic update and obstacle check
+  PROF_DISPATCH ,        // command switch and servo scheduler
+  PROF_LOOP ,            // the whole loop() pass
+  PROF_CMD_LATENCY ,     // new command received -> first servo write of its gait
+  PROF_SLEEP ,           // one low power nap (sum = time spent asleep)
+  PROF_WAKE_LATENCY ,    // command received while idle -> first servo write (legs attached again)
+  PROF_SECTION_COUNT } ;
+
+enum ProfCounter {
+  CNT_RANGE_TIMEOUT=0 ,  // pings without an echo in range
+  CNT_FORCED_STOP ,      // commands replaced by 'S' because of an obstacle
+  CNT_BAD_FRAME ,        // frames dropped by the parser (bad crc or length)
+  CNT_RANGE_OUTLIER ,    // echoes rejected by the range filter
+  CNT_TELEM_DROPPED ,    // telemetry records overwritten before there was room to send them
+  CNT_LEASE_EXPIRED ,    // stops because the host stopped renewing the command lease
+  PROF_COUNTER_COUNT } ;
+
+struct ProfStat {
+  uint32_t count ;
+  uint32_t sum_us ;
+  uint16_t min_us ;
+  uint16_t max_us ;      // durations are clamped to 65535 us
+} ;
+
+#if ROBOT_PROFILING
+#define PROF_START(var)          unsigned long var = micros()             // start timing a section
+#define PROF_STOP(section , var) prof_record(section , micros() - var)   // stop timing it and record the duration
+#define PROF_COUNT(counter)      prof_count(counter)
+#else
+#define PROF_START(var)
+#define PROF_STOP(section , var)
+#define PROF_COUNT(counter)
+#endif
+
+void prof_record(uint8_t section , unsigned long duration_us);   // section = ProfSection
+void prof_count(uint8_t counter);                                 // counter = ProfCounter
+void prof_reset();
+void prof_send_stats();      // one OP_STATS_SECTION frame per section and one OP_STATS_COUNTERS frame
+                             // about 80 bytes , only sent on request so it may wait for room in the UART buffer
+
+#endif
@@ -0,0 +1,145 @@
+#include "Protocol.h"
+#include "Profiler.h"
+#include <Arduino.h>
+
+static ProtoState proto_state = PROTO_WAIT_SYNC ;   // parser state is kept between calls , a frame may arrive over several loops
+static ProtoFrame rx_frame ;                        // frame being received
+static uint8_t rx_index = 0 ;                       // payload bytes received so far
+static uint8_t tx_seq = 0 ;                         // sequence number of the frames sent to the host
+
+
+uint8_t crc8(const uint8_t *data , uint8_t len , uint8_t crc)
+{
+    while (len--)
+    {
+        crc ^= *data++ ;
+        for (uint8_t i = 0 ; i < 8 ; i++)      // bitwise , a lookup table would cost 256 bytes of flash for a few bytes per frame
+        {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+        }
+    }
+    return crc ;
+}
+
+uint16_t proto_u16(const uint8_t *p)
+{
+    return (uint16_t)p[0] | ((uint16_t)p[1] << 8);
+}
+
+uint8_t *proto_put_u16(uint8_t *p , uint16_t v)
+{
+    *p++ = v & 0xFF ;
+    *p++ = v >> 8 ;
+    return p ;
+}
+
+uint8_t *proto_put_u32(uint8_t *p , uint32_t v)
+{
+    p = proto_put_u16(p , v & 0xFFFF);
+    return proto_put_u16(p , v >> 16);
+}
+
+void protocol_send(uint8_t opcode , const uint8_t *payload , uint8_t len)
+{
+    uint8_t buf[PROTO_MAX_PAYLOAD + 5];          // built in one buffer so it is handed to the UART in a single write
+    if (len > PROTO_MAX_PAYLOAD){len = PROTO_MAX_PAYLOAD ;}
+
+    buf[0] = PROTO_SYNC ;
+    buf[1] = opcode ;
+    buf[2] = tx_seq++ ;
+    buf[3] = len ;
+    memcpy(&buf[4] , payload , len);
+    buf[4 + len] = crc8(&buf[1] , len + 3 , 0);
+    Serial.write(buf , len + 5);
+}
+
+static bool proto_feed(uint8_t b)      // parses one byte , returns true when rx_frame holds a complete valid frame
+{
+    switch (proto_state)
+    {
+        case PROTO_WAIT_SYNC:
+            if (b == PROTO_SYNC)
+            {
+                proto_state = PROTO_OPCODE ;
+            }
+            else if (b == 'F' || b == 'L' || b == 'R' || b == 'S')   // legacy single letter command
+            {
+                rx_frame.opcode = OP_CMD ;
+                rx_frame.seq = 0 ;
+                rx_frame.len = 1 ;
+                rx_frame.payload[0] = b ;
+                return true ;
+            }
+            break;
+
+        case PROTO_OPCODE:
+            rx_frame.opcode = b ;
+            proto_state = PROTO_SEQ ;
+            break;
+
+        case PROTO_SEQ:
+            rx_frame.seq = b ;
+            proto_state = PROTO_LEN ;
+            break;
+
+        case PROTO_LEN:
+            if (b > PROTO_MAX_PAYLOAD)
+            {
+                PROF_COUNT(CNT_BAD_FRAME);
+                proto_state = PROTO_WAIT_SYNC ;    // can't be a valid frame , look for the next sync byte
+                break;
+            }
+            rx_frame.len = b ;
+            rx_index = 0 ;
+            proto_state = (b == 0) ? PROTO_CRC : PROTO_PAYLOAD ;
+            break;
+
+        case PROTO_PAYLOAD:
+            rx_frame.payload[rx_index++] = b ;
+            if (rx_index == rx_frame.len)
+            {
+                proto_state = PROTO_CRC ;
+            }
+            break;
+
+        case PROTO_CRC:
+        {
+            proto_state = PROTO_WAIT_SYNC ;
+            uint8_t crc = crc8(&rx_frame.opcode , 3 , 0);     // opcode , seq and len are the first 3 bytes of the struct
+            crc = crc8(rx_frame.payload , rx_frame.len , crc);
+            if (crc != b)
+            {
+                PROF_COUNT(CNT_BAD_FRAME);
+                return false ;
+            }
+            return true ;
+        }
+    }
+    return false ;
+}
+
+void protocol_poll(ProtoHandler handler)    // used inside a loop
+{
+    ProtoFrame cmd_frame ;                   // newest command received in this call
+    bool have_cmd = false ;
+
+    while (Serial.available() > 0)          // drain the whole buffer instead of one byte per loop
+    {
+        if (!proto_feed((uint8_t)Serial.read())){continue ;}
+
+        if (rx_frame.opcode == OP_CMD)
+        {
+            cmd_frame = rx_frame ;           // older commands in the same batch are superseded
+            have_cmd = true ;
+        }
+        else
+        {
+            handler(rx_frame);
+        }
+    }
+
+    if (have_cmd)
+    {
+        handler(cmd_frame);
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+#include <stdint.h>
+
+/*
+ Binary serial frame (host <-> Arduino)
+   [SYNC 0xA5] [opcode] [seq] [len] [payload 0..PROTO_MAX_PAYLOAD bytes] [crc8]
+ - crc8 covers opcode , seq , len and payload (polynomial 0x07 , initial value 0)
+ - multi-byte payload values are little endian
+ - the single ASCII letters F / L / R / S are still accepted between frames (serial monitor and older hosts)
+*/
+
+#define PROTO_SYNC        0xA5
+#define PROTO_VERSION     3     // sent in OP_READY , bumped when a frame layout changes
+                                //   2 : OP_TELEMETRY state is a step index , gaits backward / custom , commands B and G
+                                //   3 : optional trace id in OP_CMD , OP_TRACE
+#define PROTO_MAX_PAYLOAD 16
+#define PROTO_LEASE_MS    500   /* command lease armed by the first OP_HEARTBEAT
+                                   - every OP_CMD or OP_HEARTBEAT renews it
+                                   - the robot stops when nothing renewed it for the lease time (host frozen or unplugged)
+                                   - hosts that never send a heartbeat (serial monitor , legacy letters) have no lease
+                                */
+
+#define OP_CMD         0x01   // payload : command letter 'F' , 'B' , 'L' , 'R' , 'G' or 'S' , optional speed 1..SPEED_MAX (default SPEED_MAX)
+                              //           optional trace id (uint16) , echoed in OP_TRACE when the command reaches the servos
+#define OP_GAIT_TIMING 0x02   // payload : gait id (GaitId or GAIT_ALL) , motion time ms (uint16) , stop time ms (uint16)
+#define OP_GAIT_PRESET 0x03   // payload : gait id (GaitId or GAIT_ALL) , preset (GaitPreset)
+#define OP_GAIT_SAVE   0x04   // no payload , writes the gait table to EEPROM
+#define OP_STATS_REQ   0x05   // payload : optional reset flag (1 -> clear the statistics after the dump)
+#define OP_TELEM_RATE  0x06   // payload : telemetry period ms (uint16) , 0 -> no telemetry
+                              //           an obstacle stop is released by the next OP_CMD , without telemetry the host resends it blindly
+#define OP_HEARTBEAT   0x07   // payload : optional lease ms (uint16 , default PROTO_LEASE_MS) , 0 -> no lease
+#define OP_GAIT_STEPS  0x08   // payload : first step index , total steps , up to 4 steps of leg , speed (int8 %) , duration (GaitStep)
+                              //           loads the RAM gait slot run by the 'G' command
+
+// replies from the Arduino have the high bit set
+#define OP_STATS_SECTION  0x81   // payload : section (ProfSection) , count (uint32) , min us , avg us , max us (uint16)
+#define OP_STATS_COUNTERS 0x82   // payload : one uint16 per ProfCounter , in enum order
+#define OP_TELEMETRY      0x83   // payload : millis (uint32) , command letter , speed , Gait , step index ,
+                                 //           filtered distance mm (int16 , -1 no obstacle in range) , flags (TELEM_* in Telemetry.h)
+#define OP_READY          0x84   // payload : PROTO_VERSION , sent once at the end of setup() (the host waits for it after the reset)
+#define OP_TRACE          0x85   // payload : trace id (uint16) , micros() when the OP_CMD was handled (uint32) ,
+                                 //           us until its first servo write (uint32) , us until that pulse is output (uint16 , SERVO_DELAY_UNKNOWN)
+
+enum ProtoState {
+  PROTO_WAIT_SYNC=0 ,
+  PROTO_OPCODE ,
+  PROTO_SEQ ,
+  PROTO_LEN ,
+  PROTO_PAYLOAD ,
+  PROTO_CRC } ; // finite state machine of the frame parser
+
+struct ProtoFrame {
+  uint8_t opcode ;
+  uint8_t seq ;         // sequence number set by the host , 0 for legacy ASCII commands
+  uint8_t len ;         // payload length
+  uint8_t payload[PROTO_MAX_PAYLOAD] ;
+} ;
+
+typedef void (*ProtoHandler)(const ProtoFrame &frame);
+
+void protocol_poll(ProtoHandler handler);   /*- drains every byte waiting in the UART buffer , call it every loop
+                                              - frames are passed to handler in the order they arrived
+                                                except OP_CMD : only the newest one is passed , after all the others
+                                              - frames with a bad crc or length are dropped
+                                             */
+void protocol_send(uint8_t opcode , const uint8_t *payload , uint8_t len);   // sends one frame to the host
+                                                   // len is truncated to PROTO_MAX_PAYLOAD
+uint8_t crc8(const uint8_t *data , uint8_t len , uint8_t crc);   // crc8 update (polynomial 0x07)
+uint16_t proto_u16(const uint8_t *p);       // reads a little endian uint16 from a payload
+uint8_t *proto_put_u16(uint8_t *p , uint16_t v);   // writes a little endian value into a payload , returns the next position
+uint8_t *proto_put_u32(uint8_t *p , uint32_t v);
+
+#endif
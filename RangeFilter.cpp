@@ -0,0 +1,156 @@
+#include "RangeFilter.h"
+#include <Arduino.h>
+
+struct RangeState {
+  int16_t samples[RANGE_MEDIAN_N];   // ring of accepted raw samples (mm)
+  uint8_t next ;                     // slot of the next sample
+  uint8_t count ;                    // samples in the ring (up to RANGE_MEDIAN_N)
+  uint8_t rejects ;                  // consecutive outliers
+  int16_t median ;
+  int16_t speed ;                    // smoothed closing speed (mm/s)
+  int16_t hist_mm[RANGE_VEL_N];      // ring of recent filtered values ...
+  uint16_t hist_ms[RANGE_VEL_N];     // ... and their times (low 16 bits of millis() , differences are still exact)
+  uint8_t hist_next ;
+  uint8_t hist_count ;
+  bool risk ;                        // latched result of range_collision_risk()
+} ;
+
+static RangeState range_state[RANGE_MAX_SENSORS];   // one filter per ultrasonic sensor
+
+
+void range_filter_reset()
+{
+    for (uint8_t i = 0 ; i < RANGE_MAX_SENSORS ; i++)
+    {
+        RangeState &r = range_state[i];
+        r.next = 0 ;
+        r.count = 0 ;
+        r.rejects = 0 ;
+        r.median = RANGE_NO_ECHO_MM ;
+        r.speed = 0 ;
+        r.hist_count = 0 ;
+        r.risk = false ;
+    }
+}
+
+static int16_t range_compute_median(const RangeState &r)
+{
+    int16_t sorted[RANGE_MEDIAN_N];
+    for (uint8_t i = 0 ; i < r.count ; i++)     // insertion sort , at most RANGE_MEDIAN_N values
+    {
+        int16_t v = r.samples[i];
+        uint8_t j = i ;
+        while (j > 0 && sorted[j - 1] > v)
+        {
+            sorted[j] = sorted[j - 1];
+            j-- ;
+        }
+        sorted[j] = v ;
+    }
+    return sorted[r.count / 2];
+}
+
+bool range_filter_add_mm(int16_t distance_mm , unsigned long t_ms , uint8_t sensor)
+{
+    if (sensor >= RANGE_MAX_SENSORS){return false ;}
+    RangeState &r = range_state[sensor];
+    if (distance_mm < 0 || distance_mm > RANGE_NO_ECHO_MM){distance_mm = RANGE_NO_ECHO_MM ;}   // no echo -> far away
+
+    bool jumped = false ;
+    if (r.count > 0 && abs(distance_mm - r.median) > RANGE_OUTLIER_MM)
+    {
+        if (++r.rejects < RANGE_OUTLIER_CONFIRM){return false ;}   // single spike , ignored
+        r.count = 0 ;          // several in a row -> the scene really changed , restart the window from here
+        r.next = 0 ;
+        r.speed = 0 ;          // a jump is not a speed
+        jumped = true ;
+    }
+    r.rejects = 0 ;
+
+    r.samples[r.next] = distance_mm ;
+    r.next = (r.next + 1) % RANGE_MEDIAN_N ;
+    if (r.count < RANGE_MEDIAN_N){r.count++ ;}
+
+    r.median = range_compute_median(r);
+
+    if (jumped || r.median >= RANGE_NO_ECHO_MM)
+    {
+        r.hist_count = 0 ;     // nothing in range or a new scene , no speed history to compare with
+        r.speed = 0 ;
+        return true ;
+    }
+
+    r.hist_mm[r.hist_next] = r.median ;
+    r.hist_ms[r.hist_next] = (uint16_t) t_ms ;
+    r.hist_next = (r.hist_next + 1) % RANGE_VEL_N ;
+    if (r.hist_count < RANGE_VEL_N){r.hist_count++ ;}
+
+    if (r.hist_count > 1)
+    {
+        uint8_t oldest = (r.hist_next + RANGE_VEL_N - r.hist_count) % RANGE_VEL_N ;
+        uint8_t newest = (r.hist_next + RANGE_VEL_N - 1) % RANGE_VEL_N ;
+        uint16_t dt = r.hist_ms[newest] - r.hist_ms[oldest];
+        if (dt > 0)
+        {
+            int32_t speed = (int32_t)(r.hist_mm[oldest] - r.hist_mm[newest]) * 1000 / dt ;
+            speed = constrain(speed , -RANGE_SPEED_MAX , RANGE_SPEED_MAX);   // keeps the smoothed value in 16 bits
+            r.speed += (int16_t)((speed - r.speed) / (1 << RANGE_VEL_SHIFT));   // division , not a shift : rounds negative values the same way
+        }
+    }
+    return true ;
+}
+
+int16_t range_filtered_mm(uint8_t sensor)
+{
+    if (sensor >= RANGE_MAX_SENSORS){return -1 ;}
+    const RangeState &r = range_state[sensor];
+    if (r.count == 0 || r.median >= RANGE_NO_ECHO_MM){return -1 ;}
+    return r.median ;
+}
+
+int16_t range_closing_speed_mm(uint8_t sensor)
+{
+    if (sensor >= RANGE_MAX_SENSORS){return 0 ;}
+    const RangeState &r = range_state[sensor];
+    return r.speed ;
+}
+
+bool range_collision_risk(uint8_t sensor)
+{
+    if (sensor >= RANGE_MAX_SENSORS){return false ;}
+    RangeState &r = range_state[sensor];
+    int16_t distance_mm = range_filtered_mm(sensor);
+    if (distance_mm < 0)
+    {
+        r.risk = false ;       // nothing within range
+        return r.risk ;
+    }
+
+    int32_t approach = (r.speed > 0) ? (int32_t) r.speed * RANGE_TTC_MS / 1000 : 0 ;   // distance covered before the deadline
+    int32_t stop_at = RANGE_STOP_MM + approach ;
+    if (distance_mm <= stop_at)
+    {
+        r.risk = true ;
+    }
+    else if (distance_mm > stop_at + RANGE_CLEAR_MM)
+    {
+        r.risk = false ;
+    }
+    return r.risk ;            // between the two limits the previous answer is kept
+}
+
+bool range_filter_add(float distance , unsigned long t_ms)
+{
+    return range_filter_add_mm((distance < 0) ? -1 : (int16_t)(distance * 10 + 0.5) , t_ms);
+}
+
+float range_filtered()
+{
+    int16_t distance_mm = range_filtered_mm();
+    return (distance_mm < 0) ? -1 : distance_mm / 10.0 ;
+}
+
+float range_closing_speed()
+{
+    return range_closing_speed_mm() / 10.0 ;
+}
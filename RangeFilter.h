@@ -0,0 +1,37 @@
+#ifndef RANGE_FILTER_H
+#define RANGE_FILTER_H
+#include <stdint.h>
+
+#define RANGE_MAX_SENSORS     3      // independent filters , one per ultrasonic sensor (ULTRSNC_MAX_SENSORS in Robot.h)
+#define RANGE_MEDIAN_N        5      // raw samples in the median window (odd) , 5 pings = 150 ms at ULTRSNC_PING_MOVING_MS
+#define RANGE_NO_ECHO_MM      400    // value used for "no obstacle in range" (-1) so the median keeps working
+#define RANGE_OUTLIER_MM      100    // samples further than this from the filtered distance are rejected ...
+#define RANGE_OUTLIER_CONFIRM 2      // ... unless this many in a row agree (a real obstacle appeared)
+#define RANGE_VEL_N           6      // filtered values the closing speed is measured across (oldest to newest)
+                                     // a longer baseline keeps echo jitter from looking like speed
+#define RANGE_SPEED_MAX       10000L // mm/s , faster closing speeds are clipped (only possible with broken timestamps)
+#define RANGE_VEL_SHIFT       1      // smoothing of the closing speed , each new value moves it by 1/2^RANGE_VEL_SHIFT (0 -> no smoothing)
+
+#define RANGE_STOP_MM         150    // always stop this close , whatever the speed (the old fixed threshold , the floor is kept)
+#define RANGE_TTC_MS          1000   // stop when the obstacle would be within RANGE_STOP_MM in less than this time
+#define RANGE_CLEAR_MM        30     // hysteresis , the stop is released only this much beyond the stop distance
+
+// sensor selects the filter , 0 (the head) by default
+void range_filter_reset();        // every sensor
+bool range_filter_add_mm(int16_t distance_mm , unsigned long t_ms , uint8_t sensor = 0);   // distance_mm = latest_distance_mm(sensor) , t_ms = millis() of the measurement
+                                                                      // returns false if the sample was rejected as an outlier
+int16_t range_filtered_mm(uint8_t sensor = 0);      // median filtered distance in mm , -1 if no obstacle in range or no samples yet
+int16_t range_closing_speed_mm(uint8_t sensor = 0); // mm/s , positive while the obstacle gets closer , 0 when unknown
+bool range_collision_risk(uint8_t sensor = 0);     /* time to collision check , replaces the fixed 15 cm threshold
+                                    - true within RANGE_STOP_MM or if the obstacle is reached in less than RANGE_TTC_MS
+                                    - released once the distance is RANGE_CLEAR_MM beyond the stop distance
+                                    - a robot in open space keeps walking , a fast approach stops earlier than a slow one
+                                    - integer math only , cheap enough for every loop pass
+                                 */
+
+// compatibility wrappers in cm for sensor 0 , they convert at the call and are not used by the sketch
+bool range_filter_add(float distance , unsigned long t_ms);
+float range_filtered();
+float range_closing_speed();
+
+#endif
@@ -1,40 +1,122 @@
 #include "Robot.h"
 #include <Arduino.h>
-#include <Servo.h>
 
-// ultrasonic head pins
-int echo = 0 ;       // defined globally to be used in read_distance function easily without passing them as parameters
-int trig = 0 ;
+#if SERVO_BACKEND_TIMER1
+#if !defined(__AVR_ATmega328P__) && !defined(__AVR_ATmega328__) && !defined(__AVR_ATmega168__)
+#error "SERVO_BACKEND_TIMER1 needs the ATmega328P/168 Timer1 pins (9 and 10) , set it to 0 for this board"
+#endif
+#define TIMER1_TICKS_PER_US (F_CPU / 8 / 1000000UL)      // prescaler 8 -> 2 ticks per microsecond at 16 MHz
+#define TIMER1_TOP (20000UL * TIMER1_TICKS_PER_US - 1)    // 20 ms servo period
+#endif
 
-// servo objects
-Servo leg1;
-Servo leg2;
+Robot robot ;        // default instance behind the free functions
 
+static Robot *echo_robots[ROBOT_MAX_INSTANCES];   // robots with an echo pin , served by the pin change interrupts
+static uint8_t echo_robot_count = 0 ;
 
 /***********************Setup Functions************************************************/
 
-void R_leg_setup(int pin)         // right leg
+#if SERVO_BACKEND_TIMER1
+static volatile uint16_t *timer1_servo_attach(int pin)   // connects pin 9 (OC1A) or 10 (OC1B) to Timer1 , returns its compare register
 {
+    if (TCCR1B == 0 || ICR1 != TIMER1_TOP)       // first leg , start Timer1 in fast PWM mode 14 (TOP = ICR1)
+    {
+        TCCR1B = 0 ;                             // stop the timer while it is configured
+        TCCR1A = (1 << WGM11);
+        ICR1 = TIMER1_TOP ;
+        TCNT1 = 0 ;
+        TCCR1B = (1 << WGM13) | (1 << WGM12) | (1 << CS11);   // prescaler 8
+    }
+
+    if (pin == 9)
+    {
+        OCR1A = SERVO_STOP_US * TIMER1_TICKS_PER_US ;   // start stopped , the hardware then repeats the pulse on its own
+        DDRB |= (1 << DDB1);
+        TCCR1A |= (1 << COM1A1);                 // non inverting output on OC1A
+        return &OCR1A ;
+    }
+    if (pin == 10)
+    {
+        OCR1B = SERVO_STOP_US * TIMER1_TICKS_PER_US ;
+        DDRB |= (1 << DDB2);
+        TCCR1A |= (1 << COM1B1);                 // non inverting output on OC1B
+        return &OCR1B ;
+    }
+    return 0 ;                                   // not a Timer1 pin , the leg stays unattached
+}
+#endif
+
+void Robot::R_leg_setup(int pin)         // right leg
+{
+#if SERVO_BACKEND_TIMER1
+    leg1_ocr = timer1_servo_attach(pin);
+#else
+    leg1_pin = pin ;
     leg1.attach(pin);
+#endif
 }
 
-void L_leg_setup(int pin)         // left leg
+void Robot::L_leg_setup(int pin)         // left leg
 {
+#if SERVO_BACKEND_TIMER1
+    leg2_ocr = timer1_servo_attach(pin);
+#else
+    leg2_pin = pin ;
     leg2.attach(pin);
+#endif
+}
+
+void Robot::ultrsnc_head_setup(int echo1 , int trig1)
+{
+    ultrsnc_sensor_setup(0 , echo1 , trig1);   // calling it again moves the head to other pins
+    if (sensor_count == 0){sensor_count = 1 ;}
 }
 
-void ultrsnc_head_setup(int echo1 , int trig1)
+int8_t Robot::ultrsnc_add_sensor(int echo1 , int trig1)
 {
-    echo = echo1 ; trig = trig1 ;
-    pinMode(echo , INPUT);
-    pinMode(trig , OUTPUT);
+    if (sensor_count == 0){sensor_count = 1 ;}        // slot 0 stays reserved for the head
+    if (sensor_count >= ULTRSNC_MAX_SENSORS){return -1 ;}
+    ultrsnc_sensor_setup(sensor_count , echo1 , trig1);
+    return sensor_count++ ;
+}
+
+void Robot::ultrsnc_sensor_setup(uint8_t sensor , int echo1 , int trig1)
+{
+    UltrsncSensor &s = sensors[sensor];
+    s.echo = echo1 ; s.trig = trig1 ;
+    pinMode(s.echo , INPUT);
+    pinMode(s.trig , OUTPUT);
+    s.trig_pin.attach(s.trig);
+#if FAST_PIN_AVAILABLE && ULTRSNC_TRIG_PIN >= 0
+    s.trig_fast = (s.trig == ULTRSNC_TRIG_PIN);
+#endif
+    last_distance_mm[sensor] = -1 ;
+
+    if (!echo_registered && echo_robot_count < ROBOT_MAX_INSTANCES)   // first setup of this robot , let the interrupts find it
+    {
+        uint8_t sreg = SREG ;
+        cli();
+        echo_robots[echo_robot_count++] = this ;
+        echo_registered = true ;
+        SREG = sreg ;
+    }
+    s.echo_mask = digitalPinToBitMask(s.echo);
+    s.echo_in_reg = portInputRegister(digitalPinToPort(s.echo));
+
+    volatile uint8_t *pcicr = digitalPinToPCICR(s.echo);   // enable the pin change interrupt of the echo pin
+    if (pcicr)                                              // null if the pin has no pin change interrupt
+    {
+        *digitalPinToPCMSK(s.echo) |= bit(digitalPinToPCMSKbit(s.echo));
+        *pcicr |= bit(digitalPinToPCICRbit(s.echo));
+    }
 }
 
 
 /***********************Functions of operation*****************************************/ 
 
-void robot_stop()                         // robot initialization
+void Robot::stop()                        // robot initialization
 {
+    sched_clear();                        // drop queued steps so they can't restart the legs
 
     leg_act(RIGHT_LEG, STOP);
     leg_act(LEFT_LEG, STOP);
@@ -42,19 +124,36 @@ void robot_stop()                         // robot initialization
 }
 
 
-float read_distance()
+void Robot::ultrsnc_trigger(uint8_t sensor)
 {
-    float distance = 0 ;
-    unsigned long duration = 0 ;
-    digitalWrite(trig , LOW);             // Insuring that trig pin is LOW at the beginning
-    delayMicroseconds(2);                   // trig off for 2 microseconds
-    digitalWrite(trig , HIGH);
-    delayMicroseconds(10);              
+    UltrsncSensor &s = sensors[sensor];
+#if FAST_PIN_AVAILABLE && ULTRSNC_TRIG_PIN >= 0
+    if (s.trig_fast)                        // single sbi / cbi instructions , the pulse is exactly as long as the delay
+    {
+        FastPin<ULTRSNC_TRIG_PIN>::low();
+        delayMicroseconds(2);
+        FastPin<ULTRSNC_TRIG_PIN>::high();
+        delayMicroseconds(10);
+        FastPin<ULTRSNC_TRIG_PIN>::low();
+        return ;
+    }
+#endif
+    s.trig_pin.low();                     // Insuring that trig pin is LOW at the beginning
+    delayMicroseconds(2);                 // trig off for 2 microseconds
+    s.trig_pin.high();
+    delayMicroseconds(10);
     /**triggering pulse for 10 microseconds
     to send the echo signal**/
-    
-    digitalWrite(trig , LOW);
-    duration = pulseIn(echo, HIGH, 2332UL);
+
+    s.trig_pin.low();
+}
+
+int16_t Robot::read_distance_mm(uint8_t sensor)
+{
+    if (sensor >= sensor_count){return -1 ;}
+    unsigned long duration = 0 ;
+    ultrsnc_trigger(sensor);
+    duration = pulseIn(sensors[sensor].echo, HIGH, ULTRSNC_TIMEOUT_US);
     // Echo pin is high until receiving the pulse again or after timeout of 2332 microseconds
     // in other words it can't read distance more than approximately 40 cm which is enough for our robot obstacle detection
     // this prevents getting stucked in pulseIn function if no obstacle is detected within range
@@ -64,14 +163,227 @@ float read_distance()
     {
         return -1 ;   // timeout occurred , no obstacle detected within range
     }
-    distance = (duration * 0.0343) / 2.0 ;       // distance calculation (cm)
+    return ECHO_US_TO_MM(duration) ;   // distance calculation (mm) , fixed point
+}
 
-    return distance ;
+float Robot::read_distance(uint8_t sensor)
+{
+    int16_t distance_mm = read_distance_mm(sensor);
+    return (distance_mm < 0) ? -1 : distance_mm / 10.0 ;   // cm
 }
 
 
-void leg_act(int leg , int servo_action)      // leg action function instead of writing leg1.write or leg2.write every time
+void Robot::echo_edge()            // called from the pin change interrupt on every edge of the port holding the echo pin
+{
+    const UltrsncSensor &s = sensors[ultrsnc_active];
+    if (!s.echo_in_reg){return ;}
+    unsigned long now = micros();
+    if (*s.echo_in_reg & s.echo_mask)   // rising edge -> echo pulse started
+    {
+        if (ultrsnc_state == ULTRSNC_WAIT_RISE)
+        {
+            echo_rise_us = now ;
+            ultrsnc_state = ULTRSNC_WAIT_FALL ;
+        }
+    }
+    else if (ultrsnc_state == ULTRSNC_WAIT_FALL)   // falling edge -> echo received
+    {
+        echo_fall_us = now ;
+        ultrsnc_state = ULTRSNC_DONE ;
+    }
+    // edges of other pins on the same port (other sensors , another robot's echo pin) and late edges of abandoned pings are ignored by the state checks
+}
+
+static void echo_edges()           // every robot checks its own pin , there is one vector per port and not per pin
+{
+    for (uint8_t i = 0 ; i < echo_robot_count ; i++)
+    {
+        echo_robots[i]->echo_edge();
+    }
+}
+
+#if defined(PCINT0_vect)
+ISR(PCINT0_vect) { echo_edges(); }
+#endif
+#if defined(PCINT1_vect)
+ISR(PCINT1_vect) { echo_edges(); }
+#endif
+#if defined(PCINT2_vect)
+ISR(PCINT2_vect) { echo_edges(); }
+#endif
+
+void Robot::ultrsnc_finish(int16_t distance_mm)   // store a result and get ready for the next ping
+{
+    last_distance_mm[ultrsnc_active] = distance_mm ;
+    distance_new |= bit(ultrsnc_active);
+    done_ms = millis();
+    ultrsnc_next = (ultrsnc_active + 1 < sensor_count) ? ultrsnc_active + 1 : 0 ;   // round robin
+    ultrsnc_state = ULTRSNC_IDLE ;
+}
+
+unsigned long Robot::ultrsnc_period_ms()   // ping often while a leg moves , rarely when nothing moves
+{
+    if (moving_leg != 0)           // any gait , the last servo write left a leg moving
+    {
+        return ULTRSNC_PING_MOVING_MS ;
+    }
+    if (sched_pending() > 0)
+    {
+        return ULTRSNC_PING_STEP_MS ;     // the next step is coming , keep the filter fed
+    }
+    return ULTRSNC_PING_IDLE_MS ;          // a new command switches back to the fast rate on its first servo write
+}
+
+void Robot::ultrsnc_update()
+{
+    UltrsncState state ;
+    unsigned long rise , fall ;
+    noInterrupts();                // multi-byte values written by the interrupt must be copied atomically
+    state = ultrsnc_state ;
+    rise = echo_rise_us ;
+    fall = echo_fall_us ;
+    interrupts();
+
+    switch (state)
+    {
+        case ULTRSNC_IDLE:
+            if (sensor_count == 0){return ;}
+            if (ultrsnc_next == 0 && millis() - trig_ms < ultrsnc_period_ms()){return ;}   // same non-blocking delay control as move() and rotate()
+            if (millis() - done_ms < ULTRSNC_MIN_GAP_MS){return ;}    // previous echo may still be bouncing around , staggers the sensors
+            if (ultrsnc_next == 0){trig_ms = millis();}               // a new round
+            ultrsnc_active = ultrsnc_next ;
+            ultrsnc_state = ULTRSNC_WAIT_RISE ;   // armed before the pulse so the interrupt can't miss the rising edge
+            ultrsnc_trigger(ultrsnc_active);     // the only wait left , 12 microseconds for the trigger pulse
+            trig_us = micros();
+            break;
+
+        case ULTRSNC_WAIT_RISE:
+            if (micros() - trig_us > ULTRSNC_RISE_TIMEOUT_US)
+            {
+                ultrsnc_finish(-1);        // the echo never started
+            }
+            break;
+
+        case ULTRSNC_WAIT_FALL:
+            if (micros() - rise > ULTRSNC_TIMEOUT_US)
+            {
+                ultrsnc_finish(-1);        // echo longer than the range we care about , same as the pulseIn timeout
+            }
+            break;
+
+        case ULTRSNC_DONE:
+            if (fall - rise > ULTRSNC_TIMEOUT_US)
+            {
+                ultrsnc_finish(-1);
+            }
+            else
+            {
+                ultrsnc_finish(ECHO_US_TO_MM(fall - rise));   // same distance calculation as read_distance_mm()
+            }
+            break;
+    }
+}
+
+uint8_t Robot::ultrsnc_sensors()
+{
+    return sensor_count ;
+}
+
+uint8_t Robot::distances_ready()
+{
+    return distance_new ;
+}
+
+bool Robot::distance_ready(uint8_t sensor)
+{
+    return distance_new & bit(sensor);
+}
+
+int16_t Robot::latest_distance_mm(uint8_t sensor)
+{
+    if (sensor >= ULTRSNC_MAX_SENSORS){return -1 ;}
+    distance_new &= ~bit(sensor);
+    return last_distance_mm[sensor];
+}
+
+const int16_t *Robot::distances_mm()
+{
+    return last_distance_mm ;
+}
+
+float Robot::latest_distance(uint8_t sensor)
+{
+    int16_t distance_mm = latest_distance_mm(sensor);
+    return (distance_mm < 0) ? -1 : distance_mm / 10.0 ;   // cm
+}
+
+
+uint16_t Robot::servo_output_delay_us()
+{
+#if SERVO_BACKEND_TIMER1
+    uint16_t ticks = TCNT1 ;                   // 16 bit read , the hardware latches the high byte
+    return (TIMER1_TOP - ticks) / TIMER1_TICKS_PER_US ;   // OCR1x are double buffered , the new width starts with the next period
+#else
+    return SERVO_DELAY_UNKNOWN ;
+#endif
+}
+
+void Robot::legs_detach()
+{
+    if (legs_detached){return ;}
+#if SERVO_BACKEND_TIMER1
+    TCCR1A &= ~((1 << COM1A1) | (1 << COM1B1));   // pins fall back to the PORT value (LOW) , Timer1 keeps counting
+#else
+    leg1.detach();
+    leg2.detach();
+#endif
+    legs_detached = true ;
+}
+
+void Robot::legs_attach()       // called before every servo write , does nothing unless the legs were detached
+{
+    if (!legs_detached){return ;}
+#if SERVO_BACKEND_TIMER1
+    if (leg1_ocr == &OCR1A || leg2_ocr == &OCR1A){TCCR1A |= (1 << COM1A1);}
+    if (leg1_ocr == &OCR1B || leg2_ocr == &OCR1B){TCCR1A |= (1 << COM1B1);}
+#else
+    if (leg1_pin >= 0){leg1.attach(leg1_pin);}
+    if (leg2_pin >= 0){leg2.attach(leg2_pin);}
+#endif
+    legs_detached = false ;
+}
+
+void Robot::leg_write_us(int leg , int pulse_us)     // servo pulse width of one leg in microseconds
+{
+    legs_attach();
+#if SERVO_BACKEND_TIMER1
+    volatile uint16_t *ocr = (leg == RIGHT_LEG) ? leg1_ocr : (leg == LEFT_LEG) ? leg2_ocr : 0 ;
+    if (ocr)
+    {
+        uint16_t ticks = constrain(pulse_us , SERVO_MIN_US , SERVO_MAX_US) * TIMER1_TICKS_PER_US ;
+        uint8_t sreg = SREG ;
+        cli();                    // 16 bit register write goes through the shared TEMP register
+        *ocr = ticks ;            // double buffered in fast PWM , takes effect at the start of the next period
+        SREG = sreg ;
+    }
+#else
+    if (leg == RIGHT_LEG)
+    {
+        leg1.writeMicroseconds(pulse_us);
+    }
+    else if (leg == LEFT_LEG)
+    {
+        leg2.writeMicroseconds(pulse_us);
+    }
+#endif
+}
+
+void Robot::leg_act(int leg , int servo_action)      // leg action function instead of writing leg1.write or leg2.write every time
 {
+#if SERVO_BACKEND_TIMER1
+    leg_write_us(leg , map(servo_action , 0 , 180 , SERVO_MIN_US , SERVO_MAX_US));   // same angle to pulse mapping as Servo::write()
+#else
+    legs_attach();
     if (leg == RIGHT_LEG) 
     {
         leg1.write(servo_action);
@@ -80,93 +392,321 @@ void leg_act(int leg , int servo_action)      // leg action function instead of
     {
         leg2.write(servo_action);
     }
+#endif
 }
 
-void move(unsigned int t_motion_delayms , unsigned int t_stop_delayms)        // used inside a loop
-{   
-    static WalkState state = LEFT_STOP ;   // static variable to hold the current state without reseting it on each function call
-                                          // defining it every call won't take time but it is just best parctice for readability and debugging
+void Robot::leg_act_speed(int leg , int speed)
+{
+    speed = constrain(speed , -SPEED_MAX , SPEED_MAX);
+    int offset = (long)speed * (SERVO_MAX_US - SERVO_STOP_US) / SPEED_MAX ;   // long to avoid int overflow on the AVR
 
-    static unsigned long last_time = 0;   // static to hold its value without reseting it on each function call
-    
-    unsigned long now = millis();        //returns the time elapsed since the program started (milliseconds time)
-                                         //it is a 32 bit number that overflows after approximately 49.71 days
-                                         //overflow returns it to zero again
+    if (leg == RIGHT_LEG)
+    {
+        leg_write_us(leg , SERVO_STOP_US - offset);    // right leg moves forward towards MOVE_R (0 degrees)
+    }
+    else if (leg == LEFT_LEG)
+    {
+        leg_write_us(leg , SERVO_STOP_US + offset);    // left leg moves forward towards MOVE_L (180 degrees)
+    }
+}
+
+/***********************Servo timeline scheduler***************************************/
+
+
+const GaitStep gait_steps_forward[4] PROGMEM = {      // index = WalkState
+    { RIGHT_LEG ,  100 , STEP_MOTION } ,    // RIGHT_MOVING
+    { RIGHT_LEG ,    0 , STEP_STOP } ,      // RIGHT_STOP
+    { LEFT_LEG ,   100 , STEP_MOTION } ,    // LEFT_MOVING
+    { LEFT_LEG ,     0 , STEP_STOP } ,      // LEFT_STOP , the stop after the left leg belongs to this cycle
+};
+
+const GaitStep gait_steps_backward[4] PROGMEM = {
+    { RIGHT_LEG , -100 , STEP_MOTION } ,
+    { RIGHT_LEG ,    0 , STEP_STOP } ,
+    { LEFT_LEG ,  -100 , STEP_MOTION } ,
+    { LEFT_LEG ,     0 , STEP_STOP } ,
+};
+
+const GaitStep gait_steps_rotate_right[2] PROGMEM = {   // index = RotateState
+    { RIGHT_LEG ,  100 , STEP_MOTION } ,    // LEG_MOVING , leg_act_speed() picks the forward direction of each leg
+    { RIGHT_LEG ,    0 , STEP_STOP } ,      // LEG_STOP
+};
+
+const GaitStep gait_steps_rotate_left[2] PROGMEM = {
+    { LEFT_LEG ,   100 , STEP_MOTION } ,
+    { LEFT_LEG ,     0 , STEP_STOP } ,
+};
 
-    if (state == LEFT_STOP || state == RIGHT_STOP)
+static GaitStep gait_step(const GaitStep *steps , bool flash , uint8_t i)   // copy of step i from flash or RAM
+{
+    GaitStep st ;
+    if (flash)
     {
-        if (now - last_time < t_stop_delayms){return ;}   // to control delay between steps instead of delay function
-                                               //this allows other code to run during the waiting period of delay
-                                               //So the function doesn't execute the next step until the specified delay time has passed
+        memcpy_P(&st , &steps[i] , sizeof(st));
     }
     else
     {
-        if (now - last_time < t_motion_delayms){return ;}   // to control delay between steps instead of delay function
-                                               //this allows other code to run during the waiting period of delay
-                                               //So the function doesn't execute the next step until the specified delay time has passed
-    } 
-    
-    last_time = now ;           // to handle continuous increment of millis()
-  
-    switch (state)             // finite state machine
-                              // finishes one state at each fucntion call and each function call is delayed by t_delayms after the previous one
-                              // this is due to the delay control at the beginning of the function😉
-    {
-        case LEFT_STOP:                  // initial state or state after completing a full cycle
-            leg_act(RIGHT_LEG , MOVE_R);
-            state = RIGHT_MOVING ;       // state is RIGHT_MOVING until the next function call
-            break;
+        st = steps[i];
+    }
+    return st ;
+}
 
-        case RIGHT_MOVING:
-            leg_act(RIGHT_LEG , STOP);
-            state = RIGHT_STOP ;
-            break;
+static unsigned int step_ms(uint8_t duration , unsigned int t_motion_delayms , unsigned int t_stop_delayms)
+{
+    if (duration == STEP_MOTION){return t_motion_delayms ;}
+    if (duration == STEP_STOP){return t_stop_delayms ;}
+    return duration * STEP_TICK_MS ;
+}
 
-        case RIGHT_STOP:
-            leg_act(LEFT_LEG , MOVE_L);
-            state = LEFT_MOVING ;
-            break;
+#define SCHED_SLOT(i) sched_queue[(sched_head + (i)) & (SCHED_QUEUE_SIZE - 1)]
 
-        case LEFT_MOVING:
-            leg_act(LEFT_LEG , STOP);
-            state = LEFT_STOP ;
-            break;
+unsigned long Robot::sched_start()        // start time of a new cycle : end of the queued timeline or now if it already passed
+{
+    unsigned long now = millis();
+    if ((long)(now - sched_horizon) > 0)     // signed difference handles millis() overflow
+    {
+        sched_horizon = now ;
     }
+    return sched_horizon ;
 }
-void rotate(int leg , unsigned int t_motion_delayms , unsigned int t_stop_delayms)    // used inside a loop
+
+bool Robot::sched_push(unsigned long due , int leg , int speed , uint8_t gait , uint8_t state)
 {
-    static RotateState state = LEG_STOP ;   // static variable to hold the current state without reseting it on each function call
-    static unsigned long last_time = 0;
-    unsigned long now = millis();        //returns the time elapsed since the program started (milliseconds time)
-                                        //it is a 32 bit number that overflows after approximately 49.71 days
-                                        //overflow returns it to zero again
-    if (state == LEG_STOP)
+    if (sched_count == SCHED_QUEUE_SIZE){return false ;}
+
+    uint8_t i = sched_count ;
+    while (i > 0 && (long)(SCHED_SLOT(i - 1).due - due) > 0)   // shift later events back , gaits append at the end so this rarely loops
     {
-        if (now - last_time < t_stop_delayms){return ;}   // to control delay between steps instead of delay function
-                                               //this allows other code to run during the waiting period of delay
-                                               //So the function doesn't execute the next step until the specified delay time has passed
+        SCHED_SLOT(i) = SCHED_SLOT(i - 1);
+        i-- ;
     }
-    else
+    ServoEvent &ev = SCHED_SLOT(i);
+    ev.due = due ;
+    ev.leg = leg ;
+    ev.speed = speed ;
+    ev.gait = gait ;
+    ev.state = state ;
+    sched_count++ ;
+    return true ;
+}
+
+uint8_t Robot::sched_update()           // used inside a loop
+{
+    if (sched_count == 0){return 0 ;}
+
+    uint8_t fired = 0 ;
+    unsigned long now = millis();
+    while (sched_count > 0 && (long)(now - SCHED_SLOT(0).due) >= 0)   // only the earliest deadline is checked when nothing is due
     {
-        if (now - last_time < t_motion_delayms){return ;}   // to control delay between steps instead of delay function
-                                               //this allows other code to run during the waiting period of delay
-                                               //So the function doesn't execute the next step until the specified delay time has passed
+        ServoEvent &ev = SCHED_SLOT(0);
+        leg_act_speed(ev.leg , ev.speed);
+        last_gait = ev.gait ;
+        last_state = ev.state ;
+        if (ev.speed != 0)
+        {
+            moving_leg = ev.leg ;
+            moving_since = ev.due ;
+        }
+        else if (ev.leg == moving_leg)
+        {
+            moving_leg = 0 ;
+        }
+        sched_head = (sched_head + 1) & (SCHED_QUEUE_SIZE - 1);
+        sched_count-- ;
+        fired++ ;
     }
+    return fired ;
+}
+
+void Robot::sched_clear()
+{
+    sched_head = 0 ;
+    sched_count = 0 ;
+    sched_horizon = millis();
+    last_gait = GAIT_NONE ;
+    last_state = 0 ;
+    moving_leg = 0 ;
+    prog_steps = 0 ;
+}
+
+void Robot::sched_cancel()
+{
+    sched_head = 0 ;
+    sched_count = 0 ;
+    sched_horizon = millis();     // the rest of the current stop phase is skipped too
+    prog_steps = 0 ;              // the next gait_run() enters its gait from the legs' phase
+}
+
+uint8_t Robot::sched_pending()
+{
+    return sched_count ;
+}
 
-    last_time = now ;           // to handle continuous increment of millis()
-   
-    switch (state)             // finite state machine
-                              // finishes one state at each fucntion call and each function call is delayed by t_delayms after the previous one
-                              // this is due to the delay control at the beginning of the function😉
+uint8_t Robot::sched_gait()
+{
+    return last_gait ;
+}
+
+uint8_t Robot::sched_state()
+{
+    return last_state ;
+}
+
+bool Robot::sched_steps(const GaitStep *steps , bool flash , uint8_t first , uint8_t last , uint8_t gait ,
+                        int first_ms , unsigned int t_motion_delayms , unsigned int t_stop_delayms , int speed)
+{
+    if (last <= first || SCHED_QUEUE_SIZE - sched_count < last - first){return false ;}   // queue them all or nothing
+
+    unsigned long t = sched_start();
+    for (uint8_t i = first ; i < last ; i++)
     {
-        case LEG_STOP:
-            leg_act(leg ,(leg == RIGHT_LEG) ? MOVE_R : MOVE_L);   // ternary operator to choose the correct move macro based on the leg to be moved
-            state = LEG_MOVING ;
-            break;
+        GaitStep st = gait_step(steps , flash , i);
+        if (st.leg != STEP_NO_LEG)
+        {
+            sched_push(t , st.leg , (long) st.speed * speed / 100 , gait , i);
+        }
+        t += (i == first && first_ms >= 0) ? (unsigned int) first_ms : step_ms(st.duration , t_motion_delayms , t_stop_delayms);
+    }
+    sched_horizon = t ;
+    return true ;
+}
 
-        case LEG_MOVING:
-            leg_act(leg , STOP);
-            state = LEG_STOP ;
-            break;
+bool Robot::sched_move_cycle(unsigned int t_motion_delayms , unsigned int t_stop_delayms , int speed)
+{
+    return sched_steps(gait_steps_forward , true , 0 , 4 , GAIT_MOVE , -1 , t_motion_delayms , t_stop_delayms , speed);
+}
+
+bool Robot::sched_rotate_cycle(int leg , unsigned int t_motion_delayms , unsigned int t_stop_delayms , int speed)
+{
+    const GaitStep *steps = (leg == RIGHT_LEG) ? gait_steps_rotate_right : gait_steps_rotate_left ;
+    return sched_steps(steps , true , 0 , 2 , GAIT_ROTATE , -1 , t_motion_delayms , t_stop_delayms , speed);
+}
+
+unsigned int Robot::motion_left(unsigned int t_motion_delayms)   // motion time the moving leg still has in its current step
+{
+    unsigned long moved = millis() - moving_since ;
+    return (moved >= t_motion_delayms) ? 0 : t_motion_delayms - moved ;
+}
+
+bool Robot::gait_enter(const GaitStep *steps , bool flash , uint8_t count , uint8_t gait ,
+                       unsigned int t_motion_delayms , unsigned int t_stop_delayms , int speed)
+{
+    if (sched_count != 0 || count == 0){return false ;}
+
+    uint8_t first = 0 ;
+    int first_ms = -1 ;
+    if (moving_leg != 0)
+    {
+        uint8_t i = 0 ;
+        GaitStep st ;
+        for ( ; i < count ; i++)          // first step of the table that moves the leg that is moving now
+        {
+            st = gait_step(steps , flash , i);
+            if (st.leg == moving_leg && st.speed != 0){break ;}
+        }
+        if (i < count)                    // join there , the leg finishes its step at the new speed
+        {
+            first = i ;
+            first_ms = motion_left(step_ms(st.duration , t_motion_delayms , t_stop_delayms));
+            if (first_ms == 0 && i + 1 < count)            // its step is already over , continue with the next one
+            {
+                first = i + 1 ;
+                first_ms = -1 ;
+            }
+        }
+        else                              // the table doesn't use that leg , stop it in the same servo update that starts the table
+        {
+            sched_push(sched_start() , moving_leg , 0 , gait , 0);
+        }
+    }
+
+    uint8_t last = count ;
+    uint8_t room = SCHED_QUEUE_SIZE - sched_count ;
+    if (last - first > room){last = first + room ;}    // long tables are queued in parts by gait_run()
+    if (!sched_steps(steps , flash , first , last , gait , first_ms , t_motion_delayms , t_stop_delayms , speed)){return false ;}
+    prog_steps = steps ;
+    prog_pc = last ;
+    return true ;
+}
+
+void Robot::gait_run(const GaitStep *steps , bool flash , uint8_t count , uint8_t gait ,
+                     unsigned int t_motion_delayms , unsigned int t_stop_delayms , int speed)   // used inside a loop
+{
+    if (sched_count != 0 || count == 0){return ;}   // only refill when the timeline ran empty
+                                                     // the deadlines are absolute so no step is delayed by the refill
+    if (steps != prog_steps)
+    {
+        gait_enter(steps , flash , count , gait , t_motion_delayms , t_stop_delayms , speed);   // after a switch it joins the legs' phase
+        return ;
+    }
+
+    if (prog_pc >= count){prog_pc = 0 ;}            // end of the table (or the table got shorter) , next cycle
+    uint8_t last = count ;
+    if (last - prog_pc > SCHED_QUEUE_SIZE){last = prog_pc + SCHED_QUEUE_SIZE ;}
+    if (sched_steps(steps , flash , prog_pc , last , gait , -1 , t_motion_delayms , t_stop_delayms , speed))
+    {
+        prog_pc = last ;
     }
-}
\ No newline at end of file
+}
+
+bool Robot::move_enter(unsigned int t_motion_delayms , unsigned int t_stop_delayms , int speed)
+{
+    return gait_enter(gait_steps_forward , true , 4 , GAIT_MOVE , t_motion_delayms , t_stop_delayms , speed);
+}
+
+bool Robot::rotate_enter(int leg , unsigned int t_motion_delayms , unsigned int t_stop_delayms , int speed)
+{
+    const GaitStep *steps = (leg == RIGHT_LEG) ? gait_steps_rotate_right : gait_steps_rotate_left ;
+    return gait_enter(steps , true , 2 , GAIT_ROTATE , t_motion_delayms , t_stop_delayms , speed);
+}
+
+void Robot::move(unsigned int t_motion_delayms , unsigned int t_stop_delayms , int speed)        // used inside a loop
+{
+    gait_run(gait_steps_forward , true , 4 , GAIT_MOVE , t_motion_delayms , t_stop_delayms , speed);   // a normal refill starts a full cycle
+}
+
+void Robot::rotate(int leg , unsigned int t_motion_delayms , unsigned int t_stop_delayms , int speed)    // used inside a loop
+{
+    const GaitStep *steps = (leg == RIGHT_LEG) ? gait_steps_rotate_right : gait_steps_rotate_left ;
+    gait_run(steps , true , 2 , GAIT_ROTATE , t_motion_delayms , t_stop_delayms , speed);
+}
+
+
+/***********************Free function wrappers on the default robot********************/
+
+void R_leg_setup(int pin){robot.R_leg_setup(pin);}
+void L_leg_setup(int pin){robot.L_leg_setup(pin);}
+void ultrsnc_head_setup(int echo1 , int trig1){robot.ultrsnc_head_setup(echo1 , trig1);}
+int8_t ultrsnc_add_sensor(int echo1 , int trig1){return robot.ultrsnc_add_sensor(echo1 , trig1);}
+
+void robot_stop(){robot.stop();}
+int16_t read_distance_mm(uint8_t sensor){return robot.read_distance_mm(sensor);}
+float read_distance(uint8_t sensor){return robot.read_distance(sensor);}
+void ultrsnc_update(){robot.ultrsnc_update();}
+bool distance_ready(uint8_t sensor){return robot.distance_ready(sensor);}
+int16_t latest_distance_mm(uint8_t sensor){return robot.latest_distance_mm(sensor);}
+float latest_distance(uint8_t sensor){return robot.latest_distance(sensor);}
+uint8_t ultrsnc_sensors(){return robot.ultrsnc_sensors();}
+uint8_t distances_ready(){return robot.distances_ready();}
+const int16_t *distances_mm(){return robot.distances_mm();}
+void legs_detach(){robot.legs_detach();}
+uint16_t servo_output_delay_us(){return robot.servo_output_delay_us();}
+void leg_act(int leg , int servo_action){robot.leg_act(leg , servo_action);}
+void leg_act_speed(int leg , int speed){robot.leg_act_speed(leg , speed);}
+void move(unsigned int t_motion_delayms , unsigned int t_stop_delayms , int speed){robot.move(t_motion_delayms , t_stop_delayms , speed);}
+void rotate(int leg , unsigned int t_motion_delayms , unsigned int t_stop_delayms , int speed){robot.rotate(leg , t_motion_delayms , t_stop_delayms , speed);}
+
+uint8_t sched_update(){return robot.sched_update();}
+bool sched_push(unsigned long due , int leg , int speed , uint8_t gait , uint8_t state){return robot.sched_push(due , leg , speed , gait , state);}
+void sched_clear(){robot.sched_clear();}
+void sched_cancel(){robot.sched_cancel();}
+uint8_t sched_pending(){return robot.sched_pending();}
+uint8_t sched_gait(){return robot.sched_gait();}
+uint8_t sched_state(){return robot.sched_state();}
+bool sched_move_cycle(unsigned int t_motion_delayms , unsigned int t_stop_delayms , int speed){return robot.sched_move_cycle(t_motion_delayms , t_stop_delayms , speed);}
+bool sched_rotate_cycle(int leg , unsigned int t_motion_delayms , unsigned int t_stop_delayms , int speed){return robot.sched_rotate_cycle(leg , t_motion_delayms , t_stop_delayms , speed);}
+bool move_enter(unsigned int t_motion_delayms , unsigned int t_stop_delayms , int speed){return robot.move_enter(t_motion_delayms , t_stop_delayms , speed);}
+bool rotate_enter(int leg , unsigned int t_motion_delayms , unsigned int t_stop_delayms , int speed){return robot.rotate_enter(leg , t_motion_delayms , t_stop_delayms , speed);}
+void gait_run(const GaitStep *steps , bool flash , uint8_t count , uint8_t gait , unsigned int t_motion_delayms , unsigned int t_stop_delayms , int speed){robot.gait_run(steps , flash , count , gait , t_motion_delayms , t_stop_delayms , speed);}
+bool gait_enter(const GaitStep *steps , bool flash , uint8_t count , uint8_t gait , unsigned int t_motion_delayms , unsigned int t_stop_delayms , int speed){return robot.gait_enter(steps , flash , count , gait , t_motion_delayms , t_stop_delayms , speed);}
+bool sched_steps(const GaitStep *steps , bool flash , uint8_t first , uint8_t last , uint8_t gait , int first_ms , unsigned int t_motion_delayms , unsigned int t_stop_delayms , int speed){return robot.sched_steps(steps , flash , first , last , gait , first_ms , t_motion_delayms , t_stop_delayms , speed);}
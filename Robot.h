@@ -1,46 +1,324 @@
 #ifndef ROBOT_H
 #define ROBOT_H
+#include <stdint.h>
+
+#ifndef SERVO_BACKEND_TIMER1
+#define SERVO_BACKEND_TIMER1 0   // 1 -> legs driven by Timer1 hardware PWM (OC1A pin 9 , OC1B pin 10 , ATmega328P/168 only)
+                                 //      no interrupt per servo pulse , so the echo timing isn't disturbed
+                                 // 0 -> Arduino Servo library (any pin)
+#endif
+#ifndef ULTRSNC_TRIG_PIN
+#define ULTRSNC_TRIG_PIN 11      // trig pin known at compile time , the trigger pulse uses FastPin<ULTRSNC_TRIG_PIN> (direct port writes)
+                                 // ultrsnc_head_setup() with another trig pin falls back to RuntimePin , -1 -> always RuntimePin
+#endif
+#include "FastPin.h"
+#if !SERVO_BACKEND_TIMER1
+#include <Servo.h>
+#endif
 #define RIGHT_LEG 1
 #define LEFT_LEG 2
 #define MOVE_R 0     // move right leg forward command
 #define MOVE_L 180   // move left leg forward command
 #define STOP  90     // stop specified leg command
 
+#define SPEED_MAX    100    // leg_act_speed() range is -SPEED_MAX..SPEED_MAX (percent of full speed)
+#define SERVO_MIN_US 544    // pulse of write(0)   , full speed one way (same limits as the Servo library)
+#define SERVO_MAX_US 2400   // pulse of write(180) , full speed the other way
+#define SERVO_STOP_US ((SERVO_MIN_US + SERVO_MAX_US) / 2)   // pulse of write(90) , continuous rotation servo stopped
+
+#define SERVO_DELAY_UNKNOWN 0xFFFF   // servo_output_delay_us() without a backend that can tell
+#define ULTRSNC_TIMEOUT_US      2332UL   // longest echo accepted (approximately 40 cm) , longer echoes are reported as no obstacle
+#define ULTRSNC_RISE_TIMEOUT_US 10000UL  // give up if the echo never starts (sensor missing or still busy with the previous ping)
+#define ECHO_MM_Q16  11239UL     // echo time to distance in 16.16 fixed point : 0.0343 cm/us / 2 = 0.1715 mm/us
+#define ECHO_US_TO_MM(us) ((int16_t)(((uint32_t)(us) * ECHO_MM_Q16 + 0x8000UL) >> 16))   // one 32 bit multiply , no float (rounded)
+#define MM_TO_ECHO_US(mm) ((uint16_t)(((uint32_t)(mm) << 16) / ECHO_MM_Q16))           // for constant thresholds , folded by the compiler
+#define SCHED_QUEUE_SIZE 8   // timed servo events that can be queued (two forward cycles) , must be a power of 2
+#define ROBOT_MAX_INSTANCES 2   // robots whose echo pins the pin change interrupts serve
+#define ULTRSNC_MAX_SENSORS 3   // ultrasonic sensors per robot , fired one after the other (bit masks are 8 bits)
+
+#define ULTRSNC_PING_MOVING_MS  30       // time between two rounds of trigger pulses while a leg is moving
+#define ULTRSNC_PING_STEP_MS    100      // gait queued but the legs are in a stop state between steps
+#define ULTRSNC_PING_IDLE_MS    250      // nothing queued (stopped , after robot_stop())
+#define ULTRSNC_MIN_GAP_MS      20       // quiet time after the previous echo ended , so late reflections die out before the next ping
+                                         // also the stagger between the sensors of one round , no sensor hears another one's ping
+
 enum WalkState {
-  LEFT_STOP=0 , 
-  RIGHT_MOVING , 
+  RIGHT_MOVING=0 , 
   RIGHT_STOP , 
-  LEFT_MOVING } ; // finite state machine for move function
+  LEFT_MOVING , 
+  LEFT_STOP } ; // finite state machine for move function , same numbers as the steps of gait_steps_forward
 
 enum RotateState {
-  LEG_STOP=0 , 
-  LEG_MOVING } ; // finite state machine for rotate function
+  LEG_MOVING=0 , 
+  LEG_STOP } ; // finite state machine for rotate function , steps of gait_steps_rotate_*
+
+enum Gait {
+  GAIT_NONE=0 ,
+  GAIT_MOVE ,
+  GAIT_ROTATE ,
+  GAIT_BACKWARD ,
+  GAIT_CUSTOM } ; // which gait queued a servo event
+
+/*
+ Gait step tables
+ - a gait is a table of steps , each step writes one leg speed and then waits before the next step
+ - the built in tables live in flash (PROGMEM) , a custom gait can be loaded over serial into a RAM table
+ - gait_run() interprets any table onto the servo timeline , so one timing check (sched_update) serves every gait
+*/
+#define STEP_MOTION  0xFF    // duration : the motion time passed to the gait (gait_table in the sketch)
+#define STEP_STOP    0xFE    // duration : the stop time passed to the gait
+#define STEP_TICK_MS 10      // other durations are in units of STEP_TICK_MS (0..2530 ms)
+#define STEP_NO_LEG  0       // leg : no servo write , the step is only a pause
+
+struct GaitStep {
+  uint8_t leg ;            // RIGHT_LEG , LEFT_LEG or STEP_NO_LEG
+  int8_t speed ;           // -100..100 percent of the gait speed , 0 stops the leg , negative moves it backwards
+  uint8_t duration ;       // STEP_MOTION , STEP_STOP or a multiple of STEP_TICK_MS
+} ; // 3 bytes per step , the numbers of WalkState / RotateState are step indices
+
+struct ServoEvent {
+  unsigned long due ;      // millis() deadline of the servo write
+  uint8_t leg ;            // RIGHT_LEG or LEFT_LEG
+  int8_t speed ;           // value passed to leg_act_speed()
+  uint8_t gait ;           // Gait that queued the event
+  uint8_t state ;          // step of the gait table the write belongs to (WalkState or RotateState for the built in gaits)
+} ; // one entry of the servo timeline
+
+enum UltrsncState {
+  ULTRSNC_IDLE=0 ,
+  ULTRSNC_WAIT_RISE ,
+  ULTRSNC_WAIT_FALL ,
+  ULTRSNC_DONE } ; // finite state machine for the asynchronous ranging engine
+
+struct UltrsncSensor {
+  int echo ;
+  int trig ;
+  RuntimePin trig_pin ;             // cached port register of trig
+  bool trig_fast ;                  // trig == ULTRSNC_TRIG_PIN , the pulse uses FastPin
+  volatile uint8_t *echo_in_reg ;   // input register and bit mask of the echo pin
+  uint8_t echo_mask ;               // cached in setup so the interrupt doesn't look them up on every edge
+} ;
+
+/*******************Robot class*********************/
+// owns the servos , the ultrasonic head and the gait timeline of one robot
+// each member works like the free function of the same name below (stop() is robot_stop())
+// the free functions use the default instance "robot" so existing sketches keep compiling
+// with SERVO_BACKEND_TIMER1 only one robot can drive legs , Timer1 has two outputs
+
+class Robot {
+public:
+  void R_leg_setup(int pin);
+  void L_leg_setup(int pin);
+  void ultrsnc_head_setup(int echo1 , int trig1);
+  int8_t ultrsnc_add_sensor(int echo1 , int trig1);
+
+  void stop();
+  int16_t read_distance_mm(uint8_t sensor = 0);
+  float read_distance(uint8_t sensor = 0);
+  void ultrsnc_update();
+  uint8_t ultrsnc_sensors();
+  uint8_t distances_ready();
+  bool distance_ready(uint8_t sensor = 0);
+  int16_t latest_distance_mm(uint8_t sensor = 0);
+  const int16_t *distances_mm();
+  float latest_distance(uint8_t sensor = 0);
+  void legs_detach();
+  uint16_t servo_output_delay_us();
+  void leg_act(int leg , int servo_action);
+  void leg_act_speed(int leg , int speed);
+  void move(unsigned int t_motion_delayms , unsigned int t_stop_delayms , int speed = SPEED_MAX);
+  void rotate(int leg , unsigned int t_motion_delayms , unsigned int t_stop_delayms , int speed = SPEED_MAX);
+
+  uint8_t sched_update();
+  bool sched_push(unsigned long due , int leg , int speed , uint8_t gait , uint8_t state);
+  void sched_clear();
+  void sched_cancel();
+  uint8_t sched_pending();
+  uint8_t sched_gait();
+  uint8_t sched_state();
+  bool sched_move_cycle(unsigned int t_motion_delayms , unsigned int t_stop_delayms , int speed);
+  bool sched_rotate_cycle(int leg , unsigned int t_motion_delayms , unsigned int t_stop_delayms , int speed);
+  bool move_enter(unsigned int t_motion_delayms , unsigned int t_stop_delayms , int speed);
+  bool rotate_enter(int leg , unsigned int t_motion_delayms , unsigned int t_stop_delayms , int speed);
+  bool sched_steps(const GaitStep *steps , bool flash , uint8_t first , uint8_t last , uint8_t gait ,
+                   int first_ms , unsigned int t_motion_delayms , unsigned int t_stop_delayms , int speed);
+  bool gait_enter(const GaitStep *steps , bool flash , uint8_t count , uint8_t gait ,
+                  unsigned int t_motion_delayms , unsigned int t_stop_delayms , int speed);
+  void gait_run(const GaitStep *steps , bool flash , uint8_t count , uint8_t gait ,
+                unsigned int t_motion_delayms , unsigned int t_stop_delayms , int speed = SPEED_MAX);
+
+  void echo_edge();          // pin change interrupt only
+
+private:
+  void ultrsnc_sensor_setup(uint8_t sensor , int echo1 , int trig1);
+  void ultrsnc_trigger(uint8_t sensor);
+  void ultrsnc_finish(int16_t distance_mm);
+  unsigned long ultrsnc_period_ms();
+  void legs_attach();
+  void leg_write_us(int leg , int pulse_us);
+  unsigned long sched_start();
+  unsigned int motion_left(unsigned int t_motion_delayms);
+
+  // ultrasonic sensors , index 0 is the head
+  UltrsncSensor sensors[ULTRSNC_MAX_SENSORS] = {} ;
+  uint8_t sensor_count = 0 ;
+  bool echo_registered = false ;   // this robot is in the list the pin change interrupts serve
+
+#if SERVO_BACKEND_TIMER1
+  // output compare registers of the legs , set by the setup functions
+  volatile uint16_t *leg1_ocr = 0 ;
+  volatile uint16_t *leg2_ocr = 0 ;
+#else
+  // servo objects
+  Servo leg1 ;
+  Servo leg2 ;
+  int leg1_pin = -1 ;     // kept to attach the legs again after legs_detach()
+  int leg2_pin = -1 ;
+#endif
+  bool legs_detached = false ;   // true while no servo pulses are sent (low power idle)
+
+  // asynchronous ranging engine , one ping in flight at a time
+  volatile uint8_t ultrsnc_active = 0 ;  // sensor of the ping in flight , the interrupt only looks at its echo pin
+  uint8_t ultrsnc_next = 0 ;             // sensor fired next , 0 starts a new round
+  volatile UltrsncState ultrsnc_state = ULTRSNC_IDLE ;
+  volatile unsigned long echo_rise_us = 0 ;   // written by the pin change interrupt
+  volatile unsigned long echo_fall_us = 0 ;
+  unsigned long trig_us = 0 ;            // micros() when the last trigger pulse was sent (timeouts)
+  unsigned long trig_ms = 0 ;            // millis() when the first trigger pulse of the last round was sent (ping schedule)
+  unsigned long done_ms = 0 ;            // millis() when the last measurement finished (minimum gap)
+  int16_t last_distance_mm[ULTRSNC_MAX_SENSORS] = {} ;   // latest result of each sensor (-1 no echo) , returned by latest_distance_mm()
+  uint8_t distance_new = 0 ;             // bit per sensor , set when its measurement finishes , cleared by latest_distance_mm()
+
+  // servo timeline
+  ServoEvent sched_queue[SCHED_QUEUE_SIZE];   // ring buffer kept sorted by deadline , earliest at sched_head
+  uint8_t sched_head = 0 ;
+  uint8_t sched_count = 0 ;
+  unsigned long sched_horizon = 0 ;   // time at which the queued timeline ends and the next cycle may start
+  uint8_t last_gait = GAIT_NONE ;     // gait and state of the last event written to the servos
+  uint8_t last_state = 0 ;
+  uint8_t moving_leg = 0 ;            // leg the last events left moving (0 -> both stopped)
+  unsigned long moving_since = 0 ;    // deadline of the event that started it
+
+  // gait interpreter
+  const GaitStep *prog_steps = 0 ;    // table gait_run() is queueing (0 -> the next call enters a new gait)
+  uint8_t prog_pc = 0 ;               // next step of the table to queue
+} ;
+
+extern Robot robot ;     // default instance used by the free functions
 
 /*******************setup functions*********************/
 
-void R_leg_setup(int pin);
+void R_leg_setup(int pin);      // with SERVO_BACKEND_TIMER1 the pin must be 9 or 10
 void L_leg_setup(int pin);
-void ultrsnc_head_setup(int echo1 , int trig1);
+void ultrsnc_head_setup(int echo1 , int trig1);   // sensor 0 , the head
+int8_t ultrsnc_add_sensor(int echo1 , int trig1);  /* one more sensor (side , rear ...) , returns its index or -1 if ULTRSNC_MAX_SENSORS are set up
+                                                      - every echo pin needs a pin change interrupt , trig pins can be any output
+                                                    */
 
 /********************Operation functions*****************/
-void robot_stop();             // robot initialization
-float read_distance();   // ultrasonic distance reading
-                         // returns distance in cm , returns -1 if no obstacle detected within range (approximately 40 cm)
+void robot_stop();             // robot initialization , also drops every queued servo event
+int16_t read_distance_mm(uint8_t sensor = 0);   // ultrasonic distance reading
+                              // returns distance in mm , returns -1 if no obstacle detected within range (approximately 400 mm)
+                              // blocking (up to about 2.34 ms) , don't mix it with the asynchronous functions below
+float read_distance(uint8_t sensor = 0);        // same reading in cm , compatibility wrapper (the only float math left in ranging)
+
+void ultrsnc_update();       /* asynchronous ranging , call it every loop
+                                - fires the sensors round robin , a round starts on a gait phase dependent schedule (ULTRSNC_PING_*_MS)
+                                - the next sensor of a round fires ULTRSNC_MIN_GAP_MS after the previous echo , never two pings at once
+                                - collects the echo timed by the pin change interrupt , it never waits so the loop doesn't stall on the sensors
+                             */
+uint8_t ultrsnc_sensors();   // sensors set up
+uint8_t distances_ready();   // bit i set when sensor i finished a measurement since its last latest_distance_mm(i) call
+bool distance_ready(uint8_t sensor = 0);       // same for one sensor
+int16_t latest_distance_mm(uint8_t sensor = 0);   // last measured distance in mm (cached) , -1 if no obstacle detected within range
+                                // same units and meaning as read_distance_mm() , clears the sensor's bit of distances_ready()
+const int16_t *distances_mm();  // latest distance of every sensor (ultrsnc_sensors() entries) , reading it clears nothing
+float latest_distance(uint8_t sensor = 0);     // same value in cm , compatibility wrapper of latest_distance_mm()
+uint16_t servo_output_delay_us();   /* time until a pulse width written now reaches the servo wire (start of the next servo period)
+                                      - SERVO_BACKEND_TIMER1 reads the timer , 0..20000 us
+                                      - SERVO_DELAY_UNKNOWN with the Servo library (its refresh interrupt is not exposed)
+                                   */
+void legs_detach();          // stop sending servo pulses (continuous rotation servos stand still and draw less current)
+                             // the next leg_act() or leg_act_speed() attaches the legs again
 void leg_act(int leg , int servo_action);     // leg = RIGHT_LEG or LEFT_LEG
                                              // servo_action = MOVE or STOP
+void leg_act_speed(int leg , int speed);      // leg = RIGHT_LEG or LEFT_LEG
+                                             // speed = -SPEED_MAX..SPEED_MAX , positive moves the leg forward , 0 stops it
+                                             // SPEED_MAX gives the same pulse as MOVE_R / MOVE_L
 
-void move(unsigned int t_motion_delayms , unsigned int t_stop_delayms);   /*- t_motion_delayms : how much time in milliseconds one servo should move
+void move(unsigned int t_motion_delayms , unsigned int t_stop_delayms , int speed = SPEED_MAX);   /*- t_motion_delayms : how much time in milliseconds one servo should move
                                                         - t_stop_delayms : how much time in milliseconds to wait between steps
+                                                        - speed : 1..SPEED_MAX , leg speed of the queued cycles
                                                         - moving forward by moving both legs alternately
-                                                        - it moves one step at a time and used in loop to continue states
-                                                        - the delay is non-blocking so other code can run during the stop or motion states
+                                                        - used in loop , it queues the next cycle on the servo timeline whenever the timeline runs empty
+                                                        - the servo writes are done by sched_update() so other code can run during the stop or motion states
                                                        */
-void rotate(int leg , unsigned int t_motion_delayms , unsigned int t_stop_delayms); /*leg = RIGHT_LEG or LEFT_LEG
+void rotate(int leg , unsigned int t_motion_delayms , unsigned int t_stop_delayms , int speed = SPEED_MAX); /*leg = RIGHT_LEG or LEFT_LEG
                                                         - t_motion_delayms : how much time in milliseconds the servo should move
                                                         - t_stop_delayms : how much time in milliseconds to wait between steps
+                                                        - speed : 1..SPEED_MAX , a lower speed turns less per step for fine heading corrections
                                                         - rotating by moving one leg at a time
-                                                        - it moves one step at a time and then used in loop to continue states
-                                                        - the delay is non-blocking so other code can run during the stop or motion states
+                                                        - used in loop , it queues the next step on the servo timeline whenever the timeline runs empty
+                                                        - the servo writes are done by sched_update() so other code can run during the stop or motion states
                                                        */ 
 
+/********************Servo timeline scheduler*****************/
+uint8_t sched_update();       // call every loop , writes the servo events whose deadline has passed
+                              // only compares the earliest deadline when nothing is due
+                              // returns the number of events written
+bool sched_push(unsigned long due , int leg , int speed , uint8_t gait , uint8_t state);   // sorted insert by deadline
+                                                        // returns false if the queue is full
+void sched_clear();           // drop every queued event , the next cycle starts immediately
+void sched_cancel();          // gait switch without robot_stop() , drops the queued events but the legs keep moving
+                              // the next move() or rotate() enters its gait from the phase the legs are in
+uint8_t sched_pending();      // number of queued events
+uint8_t sched_gait();         // Gait of the last written event (GAIT_NONE after sched_clear)
+uint8_t sched_state();        // step index of the last written event (WalkState or RotateState for move() and rotate())
+
+bool sched_move_cycle(unsigned int t_motion_delayms , unsigned int t_stop_delayms , int speed);   /*- queues one full forward cycle after the events already queued
+                                                        - move() calls it whenever the queue runs empty
+                                                        - call it directly to queue several gaits back to back
+                                                        - returns false if there is no room for the whole cycle
+                                                       */
+bool sched_rotate_cycle(int leg , unsigned int t_motion_delayms , unsigned int t_stop_delayms , int speed);  // same for one rotate step
+
+bool move_enter(unsigned int t_motion_delayms , unsigned int t_stop_delayms , int speed);   /*- enter hook of the forward gait , move() calls it on the first refill after a gait switch
+                                                        - no leg moving : a full cycle from RIGHT_MOVING (same as sched_move_cycle)
+                                                        - a leg still moving after sched_cancel() : that leg finishes its step and the cycle continues from there
+                                                        - returns false if events are still queued
+                                                       */
+bool rotate_enter(int leg , unsigned int t_motion_delayms , unsigned int t_stop_delayms , int speed);  /*- enter hook of the rotate gait
+                                                        - the same leg still moving : it finishes its step at the new speed
+                                                        - the other leg moving : it is stopped in the same servo update that starts this leg
+                                                       */
+
+/********************Gait interpreter*****************/
+extern const GaitStep gait_steps_forward[4] PROGMEM ;      // move()
+extern const GaitStep gait_steps_backward[4] PROGMEM ;     // same cycle with both legs turning backwards
+extern const GaitStep gait_steps_rotate_right[2] PROGMEM ; // rotate(RIGHT_LEG , ...) , turns left
+extern const GaitStep gait_steps_rotate_left[2] PROGMEM ;  // rotate(LEFT_LEG , ...) , turns right
+
+void gait_run(const GaitStep *steps , bool flash , uint8_t count , uint8_t gait ,
+              unsigned int t_motion_delayms , unsigned int t_stop_delayms , int speed = SPEED_MAX);   /*- runs any step table , used in loop like move()
+                                                        - steps : count steps in flash (flash = true , PROGMEM) or in RAM
+                                                        - gait : Gait reported by sched_gait() while it runs
+                                                        - the steps are queued on the servo timeline whenever it runs empty , as many as fit ,
+                                                          so tables longer than SCHED_QUEUE_SIZE work too
+                                                        - at the end of the table it starts again from the first step
+                                                        - after sched_cancel() or with another table the first refill goes through gait_enter()
+                                                       */
+bool gait_enter(const GaitStep *steps , bool flash , uint8_t count , uint8_t gait ,
+                unsigned int t_motion_delayms , unsigned int t_stop_delayms , int speed);   /*- enter hook of every gait , the transition rule of move_enter() and rotate_enter()
+                                                        - no leg moving : the table from its first step
+                                                        - the moving leg has a moving step in the table : it finishes that step at the new speed
+                                                          and the table continues from there
+                                                        - else the moving leg is stopped in the same servo update that starts the table
+                                                        - returns false if events are still queued
+                                                       */
+bool sched_steps(const GaitStep *steps , bool flash , uint8_t first , uint8_t last , uint8_t gait ,
+                 int first_ms , unsigned int t_motion_delayms , unsigned int t_stop_delayms , int speed);   /*- queues steps first..last-1 after the events already queued
+                                                        - first_ms >= 0 replaces the duration of the first step (motion time left when joining a moving leg)
+                                                        - returns false if there is no room for all of them
+                                                       */
+
 #endif
\ No newline at end of file
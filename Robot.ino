@@ -1,61 +1,306 @@
 #include "Robot.h"
+#include "Protocol.h"
+#include "GaitParams.h"
+#include "Profiler.h"
+#include "RangeFilter.h"
+#include "Power.h"
+#include "Telemetry.h"
+
+struct SensorConfig {
+  uint8_t echo;
+  uint8_t trig;
+  const char *blocks;    // commands a collision risk on this sensor stops
+};
+const SensorConfig sensor_config[] = {
+  { 12 , 11 , "FBLRG" } ,   // head , facing forward : any movement stops , same as the single sensor robot
+#ifdef ROBOT_SIDE_SENSORS     // optional side sensors , any UNO pin works as echo pin (all of them have a pin change interrupt)
+  { 8 , 7 , "L" } ,         // left side , checks where a left turn sweeps
+  { 6 , 5 , "R" } ,         // right side
+#endif
+};
+const uint8_t sensor_config_count = sizeof(sensor_config) / sizeof(sensor_config[0]);
 
 char current_cmd = 0;    // to hold the current command until another command is received
+int current_speed = SPEED_MAX;   // leg speed of the current command , lower values give finer heading corrections
 bool stopped = false;   // to track if the robot is currently stopped or moving
+bool obstacle = false;  // the host's last moving command was stopped by a collision risk , until its path is clear or another command runs
+uint8_t risk_mask = 0;  // bit per sensor , latest range_collision_risk() of each sensor (updated when it has a new echo)
+char blocked_cmd = 0;   // command the obstacle stop replaced
+unsigned long cmd_received_us = 0;   // when the current moving command was received (command latency statistics)
+bool cmd_waiting = false;            // true until the first servo write of the new command
+bool idle = false;                   // legs detached and the MCU napping between interrupts
+bool cmd_woke = false;               // the waiting command arrived while idle (wake up latency statistics)
+unsigned long busy_ms = 0;           // last time the robot was moving or had servo events queued
+unsigned long telem_ms = 0;          // when the last telemetry record was queued
+TelemRecord telem_last = {};         // last queued record , a change in it is sent right away
+uint16_t lease_ms = 0;               // command lease (OP_HEARTBEAT) , 0 -> none
+unsigned long lease_renewed_ms = 0;  // last OP_CMD or OP_HEARTBEAT
+uint16_t trace_id = 0;               // host trace id of the last OP_CMD that carried one
+unsigned long trace_rx_us = 0;       // when that command was handled
+bool trace_pending = false;          // echoed in OP_TRACE on the next servo write
+bool lease_expired = false;          // the robot stopped on its own , until the next command
 
 void setup()
 {
   R_leg_setup(9);     // right leg pin 9
   L_leg_setup(10);    // left leg pin 10
-  ultrsnc_head_setup(12 , 11);  // echo pin 12 , trig pin 11
+  ultrsnc_head_setup(sensor_config[0].echo , sensor_config[0].trig);  // echo pin 12 , trig pin 11
+  for (uint8_t i = 1; i < sensor_config_count; i++)
+  {
+    ultrsnc_add_sensor(sensor_config[i].echo , sensor_config[i].trig);   // fired round robin after the head
+  }
+  gait_params_load();         // gait timings saved in EEPROM (PRESET_NORMAL if none)
   robot_stop();               // initialize robot to stopped state
   stopped = true;
   Serial.begin(115200);       // start serial communication at 115200 rate to receive commands from serial monitor
+  uint8_t version = PROTO_VERSION;
+  protocol_send(OP_READY , &version , 1);   // the host waits for this instead of a fixed delay after opening the port
 }
-void loop() {         // loop function runs over and over again forever
- // --- Read command from Serial ---
-  if (Serial.available() > 0)   // Check if data is available to read (not -1)
+bool cmd_blocked(char cmd)    // a sensor that guards cmd predicts a collision (cached results , no ranging here)
+{
+  for (uint8_t i = 0; i < sensor_config_count; i++)
+  {
+    if ((risk_mask & bit(i)) && strchr(sensor_config[i].blocks , cmd)){return true;}
+  }
+  return false;
+}
+
+void apply_command(char cmd , int speed)    // switch to a new movement command
+{
+  if (cmd != 'F' && cmd != 'B' && cmd != 'L' && cmd != 'R' && cmd != 'G' && cmd != 'S'){return;}   // check for valid commands only
+                                        // F -> move forward , B -> move backward , L -> rotate left , R -> rotate right
+                                        // G -> run the gait loaded with OP_GAIT_STEPS , S -> stop
+  if (speed >= 1 && speed <= SPEED_MAX)
   {
-      int in = Serial.read();    // Read the incoming byte
-      char cmd = (char) in ;    // Convert the byte to a character
-      
-      if (cmd != current_cmd && (cmd == 'F' || cmd == 'L' || cmd == 'R' || cmd == 'S'))  // check for valid commands only , also the new command must be different from the current one
-                                                                 // F -> move forward , L -> rotate left , R -> rotate right , S -> stop
+    current_speed = speed;     // same command with a new speed only changes the next queued cycle , no stop
+  }
+
+  if (cmd != current_cmd)      // the new command must be different from the current one
+  {
+    if(!stopped)
+    {
+      if (cmd == 'S')
       {
-        if(!stopped)
+        robot_stop();     // stop the robot after receiving a stop command
+        stopped = true;   // update stopped state
+      }
+      else
+      {
+        sched_cancel();   // no full stop between gaits , the next move() or rotate() joins the phase the legs are in
+                          // its transition table stops a leg the new gait doesn't use , so the two legs never move at the same time
+      }
+    }
+
+    current_cmd = cmd;     // Store the valid command for switch-case execution
+    cmd_received_us = micros();
+    cmd_waiting = (cmd != 'S');     // 'S' acts immediately through robot_stop()
+    cmd_woke = idle;
+  }
+}
+
+void trace_report(unsigned long write_us)   // the traced command reached the servos at write_us
+{
+  telem_send_trace(trace_id , trace_rx_us , write_us - trace_rx_us , servo_output_delay_us());
+  trace_pending = false;
+}
+
+void handle_frame(const ProtoFrame &frame)    // called by protocol_poll() for every valid frame
+{
+  switch (frame.opcode)
+  {
+    case OP_CMD:
+      lease_renewed_ms = millis();
+      lease_expired = false;
+      if (frame.len >= 1)
+      {
+        if (frame.len >= 4)      // traced command , the host correlates it with the camera frame it came from
         {
-          robot_stop();    // stop the robot after receiving a new valid command
-                           // if this is not done and for example the robot is moving forward and a rotate command is received
-                           // the robot may move the two legs at the same time causing moving forward instead of rotation
+          trace_id = proto_u16(&frame.payload[2]);
+          trace_rx_us = micros();
+          trace_pending = true;
+        }
+        apply_command((char) frame.payload[0] , (frame.len >= 2) ? frame.payload[1] : SPEED_MAX);   // legacy letters have no speed
+        if (trace_pending && frame.payload[0] == 'S')
+        {
+          trace_report(micros());   // robot_stop() wrote the servos already (or they were stopped)
+        }
+      }
+      break;
+
+    case OP_GAIT_TIMING:
+      if (frame.len >= 5)
+      {
+        gait_set_timing(frame.payload[0] , proto_u16(&frame.payload[1]) , proto_u16(&frame.payload[3]));   // takes effect from the next queued cycle
+      }                                                                     // out of range values are ignored
+      break;
+
+    case OP_GAIT_PRESET:
+      if (frame.len >= 2)
+      {
+        gait_apply_preset(frame.payload[0] , frame.payload[1]);
+      }
+      break;
+
+    case OP_GAIT_SAVE:
+      gait_params_save();      // only on request , EEPROM cells wear out after about 100000 writes
+      break;
 
-          stopped = true;     // update stopped state
+    case OP_GAIT_STEPS:
+      if (frame.len >= 2 && (frame.len - 2) % 3 == 0)
+      {
+        if (gait_slot_store(frame.payload[0] , frame.payload[1] , &frame.payload[2] , (frame.len - 2) / 3) &&
+            current_cmd == 'G' && gait_slot_count != 0)
+        {
+          sched_cancel();      // the last chunk arrived , the new table joins the legs' phase on the next refill
         }
+      }
+      break;
+
+    case OP_HEARTBEAT:
+      lease_ms = (frame.len >= 2) ? proto_u16(&frame.payload[0]) : PROTO_LEASE_MS;
+      lease_renewed_ms = millis();
+      break;
 
-        current_cmd = cmd;     // Store the valid command for switch-case execution
+    case OP_TELEM_RATE:
+      if (frame.len >= 2)
+      {
+        telem_set_period(proto_u16(&frame.payload[0]));
+      }
+      break;
+
+    case OP_STATS_REQ:
+      prof_send_stats();
+      if (frame.len >= 1 && frame.payload[0] == 1)
+      {
+        prof_reset();
       }
+      break;
+
+    default:     // unknown opcode , ignored so newer hosts can talk to older firmware
+      break;
+  }
+}
+
+void telem_sample()    // queues a telemetry record on the period or when the robot state changed
+{
+  if (telem_period() == 0){return;}
+
+  int16_t distance_mm = range_filtered_mm();
+  TelemRecord rec;
+  rec.t_ms = millis();
+  rec.cmd = current_cmd;
+  rec.speed = current_speed;
+  rec.gait = sched_gait();
+  rec.state = sched_state();
+  rec.distance_mm = distance_mm;     // -1 when nothing is in range
+  rec.flags = (obstacle ? TELEM_OBSTACLE : 0) | (stopped ? TELEM_STOPPED : 0) | (idle ? TELEM_IDLE : 0) | (lease_expired ? TELEM_LEASE : 0);
+
+  bool changed = rec.cmd != telem_last.cmd || rec.speed != telem_last.speed || rec.gait != telem_last.gait
+              || rec.state != telem_last.state || rec.flags != telem_last.flags;   // distance alone waits for the period
+  if (!changed && rec.t_ms - telem_ms < telem_period()){return;}
+
+  telem_push(rec);
+  telem_last = rec;
+  telem_ms = rec.t_ms;
+}
+
+void loop() {         // loop function runs over and over again forever
+  PROF_START(loop_start);
+
+ // --- Read commands from Serial ---
+  PROF_START(serial_start);
+  protocol_poll(handle_frame);   // drains the whole UART buffer , only the newest command of a batch is applied
+  PROF_STOP(PROF_SERIAL , serial_start);
+
+  // --- Command lease ---
+  if (lease_ms > 0 && current_cmd != 'S' && millis() - lease_renewed_ms >= lease_ms)   // host frozen , crashed or unplugged
+  {
+    PROF_COUNT(CNT_LEASE_EXPIRED);
+    apply_command('S' , current_speed);
+    lease_expired = true;     // a new command moves the robot again
   }
 
   // --- Obstacle detection ---
-  float distance = read_distance();
+  PROF_START(ranging_start);
+  ultrsnc_update();     // non-blocking , fires the trigger on schedule and collects the echo timed by the interrupt
 
-  if (distance > 0 && distance <= 15)   // Obstacle detected within 15 cm
+  uint8_t ready = distances_ready();   // sensors with a new measurement since the last pass
+  for (uint8_t i = 0; ready != 0 && i < sensor_config_count; i++)
   {
+    if (!(ready & bit(i))){continue;}
+    int16_t distance_mm = latest_distance_mm(i);   // integer mm , no soft float on the hot path
+    if (distance_mm < 0)
+    {
+      PROF_COUNT(CNT_RANGE_TIMEOUT);
+    }
+    if (!range_filter_add_mm(distance_mm , millis() , i))   // median of the last pings , single bad echoes are dropped
+    {
+      PROF_COUNT(CNT_RANGE_OUTLIER);
+    }
+    if (range_collision_risk(i))   // time to collision instead of a fixed 15 cm threshold
+    {
+      risk_mask |= bit(i);
+    }
+    else
+    {
+      risk_mask &= ~bit(i);
+    }
+  }
+
+  if (current_cmd != 0 && current_cmd != 'S' && cmd_blocked(current_cmd))   // risks are kept between measurements so a new command
+  {                                                                         // can't move the robot before the next ping
+    PROF_COUNT(CNT_FORCED_STOP);
+    cmd_waiting = false;
+    blocked_cmd = current_cmd;
+    obstacle = true;
+    trace_pending = false;   // that command never reaches the servos
     current_cmd = 'S';   // force STOP ->> because it writes on the current_cmd variable after it was read from Serial
   }
+  else if (obstacle && (current_cmd != 'S' || !cmd_blocked(blocked_cmd)))
+  {
+    obstacle = false;    // another command runs , or the blocked one could run again
+  }
+  PROF_STOP(PROF_RANGING , ranging_start);
 
   // --- loop ---
+  PROF_START(dispatch_start);
   switch (current_cmd)
   {
     case 'F':      // current command is Move Forward
-      move(500 , 250);      // move forward with 500 ms delay operating each servo and 250 ms delay stop between steps
+      move(gait_table[GAIT_ID_FORWARD].motion_ms , gait_table[GAIT_ID_FORWARD].stop_ms , current_speed);      // move forward , by default 500 ms operating each servo and 250 ms stop between steps
       if(stopped == true)     // note that it doesn't execute this unless stopped = true (just for clarity)
       {
         stopped = false;        // update stopped state if not updated
       }
       break;
 
+    case 'B':      // current command is Move Backward , same cycle as 'F' with the legs turning the other way
+      gait_run(gait_steps_backward , true , 4 , GAIT_BACKWARD , gait_table[GAIT_ID_FORWARD].motion_ms , gait_table[GAIT_ID_FORWARD].stop_ms , current_speed);
+      if(stopped)
+      {
+        stopped = false;        // update stopped state if not updated
+      }
+      break;
+
+    case 'G':      // current command is the custom gait in the RAM slot
+      if (gait_slot_count == 0)     // never loaded , or a new upload started : stop the leg the previous gait left moving
+      {
+        if(!stopped)
+        {
+          robot_stop();
+          stopped = true;
+        }
+        break;
+      }
+      gait_run(gait_slot , false , gait_slot_count , GAIT_CUSTOM , gait_table[GAIT_ID_FORWARD].motion_ms , gait_table[GAIT_ID_FORWARD].stop_ms , current_speed);
+      if(stopped)
+      {
+        stopped = false;        // update stopped state if not updated
+      }
+      break;
+
     case 'L':     // current command is Rotate Left
-      rotate(RIGHT_LEG, 500 , 250);   // rotate left by moving right leg with 500 ms delay operating the servo and 250 ms delay stop
+      rotate(RIGHT_LEG, gait_table[GAIT_ID_LEFT].motion_ms , gait_table[GAIT_ID_LEFT].stop_ms , current_speed);   // rotate left by moving right leg
       if(stopped)
       {
         stopped = false;        // update stopped state if not updated
@@ -63,7 +308,7 @@ void loop() {         // loop function runs over and over again forever
       break;
 
     case 'R':     // current command is Rotate Right
-      rotate(LEFT_LEG, 500 , 250);   // rotate right by moving left leg with 500 ms delay operating the servo and 250 ms delay stop
+      rotate(LEFT_LEG, gait_table[GAIT_ID_RIGHT].motion_ms , gait_table[GAIT_ID_RIGHT].stop_ms , current_speed);   // rotate right by moving left leg
       if(stopped)
       {
         stopped = false;        // update stopped state if not updated
@@ -86,4 +331,45 @@ void loop() {         // loop function runs over and over again forever
       }  
         break;
  }
+
+  uint8_t written = sched_update();     // write the servo events that are due , this is the only place the gaits touch the servos
+  if (written > 0 && trace_pending)     // a speed only change is traced to the first write of the next cycle
+  {
+    trace_report(micros());
+  }
+  if (written > 0 && cmd_waiting)
+  {
+    PROF_STOP(PROF_CMD_LATENCY , cmd_received_us);
+    if (cmd_woke)
+    {
+      PROF_STOP(PROF_WAKE_LATENCY , cmd_received_us);   // includes attaching the legs again
+    }
+    cmd_waiting = false;
+  }
+  PROF_STOP(PROF_DISPATCH , dispatch_start);
+
+  // --- Telemetry ---
+  telem_sample();   // state , distance and command the robot is really executing
+  telem_drain();    // only into free UART transmit space , the loop never waits for the host
+
+  PROF_STOP(PROF_LOOP , loop_start);
+
+  // --- Low power idle ---
+  if (!stopped || sched_pending() > 0)
+  {
+    busy_ms = millis();
+    idle = false;     // the first servo write already attached the legs again
+  }
+  else if (!idle && millis() - busy_ms >= POWER_IDLE_DELAY_MS)
+  {
+    legs_detach();    // continuous rotation servos stand still without pulses
+    idle = true;
+  }
+
+  if (idle && !Serial.available())   // nap until the next interrupt , a command wakes the loop within one timer tick
+  {
+    PROF_START(sleep_start);
+    power_idle_sleep();
+    PROF_STOP(PROF_SLEEP , sleep_start);
+  }
 }
@@ -0,0 +1,77 @@
+#include "Telemetry.h"
+#include "Protocol.h"
+#include "Profiler.h"
+#include <Arduino.h>
+
+static TelemRecord telem_queue[TELEM_QUEUE_SIZE];   // ring buffer , oldest record at telem_head
+static uint8_t telem_head = 0 ;
+static uint8_t telem_count = 0 ;
+static uint16_t telem_period_ms = TELEM_PERIOD_MS ;
+
+
+void telem_push(const TelemRecord &rec)
+{
+    if (telem_count == TELEM_QUEUE_SIZE)     // host not reading or link busy , the newest state matters most
+    {
+        telem_head = (telem_head + 1) & (TELEM_QUEUE_SIZE - 1);
+        telem_count-- ;
+        PROF_COUNT(CNT_TELEM_DROPPED);
+    }
+    telem_queue[(telem_head + telem_count) & (TELEM_QUEUE_SIZE - 1)] = rec ;
+    telem_count++ ;
+}
+
+void telem_drain()
+{
+    while (telem_count > 0 && Serial.availableForWrite() >= TELEM_RECORD_LEN + 5)   // frame = payload + sync , opcode , seq , len , crc
+    {
+        const TelemRecord &rec = telem_queue[telem_head];
+        uint8_t buf[TELEM_RECORD_LEN];
+        uint8_t *p = proto_put_u32(buf , rec.t_ms);
+        *p++ = rec.cmd ;
+        *p++ = rec.speed ;
+        *p++ = rec.gait ;
+        *p++ = rec.state ;
+        p = proto_put_u16(p , (uint16_t)rec.distance_mm);
+        *p++ = rec.flags ;
+        protocol_send(OP_TELEMETRY , buf , p - buf);   // fits in the transmit buffer , returns without waiting
+
+        telem_head = (telem_head + 1) & (TELEM_QUEUE_SIZE - 1);
+        telem_count-- ;
+    }
+}
+
+uint8_t telem_pending()
+{
+    return telem_count ;
+}
+
+void telem_set_period(uint16_t period_ms)
+{
+    telem_period_ms = period_ms ;
+    if (period_ms == 0)
+    {
+        telem_count = 0 ;     // nothing more goes out
+    }
+}
+
+uint16_t telem_period()
+{
+    return telem_period_ms ;
+}
+
+bool telem_send_trace(uint16_t trace_id , uint32_t rx_us , uint32_t queue_us , uint16_t output_us)
+{
+    if (Serial.availableForWrite() < TELEM_TRACE_LEN + 5)
+    {
+        PROF_COUNT(CNT_TELEM_DROPPED);
+        return false ;
+    }
+    uint8_t buf[TELEM_TRACE_LEN];
+    uint8_t *p = proto_put_u16(buf , trace_id);
+    p = proto_put_u32(p , rx_us);
+    p = proto_put_u32(p , queue_us);
+    p = proto_put_u16(p , output_us);
+    protocol_send(OP_TRACE , buf , p - buf);
+    return true ;
+}
@@ -0,0 +1,38 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+#include <stdint.h>
+
+#define TELEM_QUEUE_SIZE 8       // records waiting for room in the UART transmit buffer , must be a power of 2
+#define TELEM_PERIOD_MS  100     // default time between two periodic records (changes are recorded right away)
+#define TELEM_RECORD_LEN 11      // payload bytes of one OP_TELEMETRY frame
+#define TELEM_TRACE_LEN  12      // payload bytes of one OP_TRACE frame
+
+#define TELEM_OBSTACLE 0x01      // flags : the host's last moving command was replaced by 'S' , a sensor guarding it predicts a collision
+#define TELEM_STOPPED  0x02      //         legs stopped (robot_stop() done)
+#define TELEM_IDLE     0x04      //         legs detached , low power idle
+#define TELEM_LEASE    0x08      //         stopped because the command lease expired
+
+struct TelemRecord {
+  uint32_t t_ms ;          // millis() when the record was taken
+  char cmd ;               // current_cmd ('S' while an obstacle forces the stop)
+  uint8_t speed ;          // current_speed
+  uint8_t gait ;           // Gait of the last servo write (sched_gait())
+  uint8_t state ;          // step index of the last servo write in its gait table (sched_state())
+  int16_t distance_mm ;    // filtered distance , -1 if no obstacle in range
+  uint8_t flags ;          // TELEM_* bits
+} ;
+
+void telem_push(const TelemRecord &rec);   // queues one record , the oldest one is dropped when the queue is full
+void telem_drain();          /*- sends queued records while a whole frame fits in Serial.availableForWrite()
+                                - never waits for the UART , call it every loop
+                                - records left over go out in a later loop
+                             */
+uint8_t telem_pending();     // records in the queue
+void telem_set_period(uint16_t period_ms);   // 0 -> no telemetry
+uint16_t telem_period();
+bool telem_send_trace(uint16_t trace_id , uint32_t rx_us , uint32_t queue_us , uint16_t output_us);   /* OP_TRACE right away
+                                - same rule as telem_drain() : dropped (false) if the frame doesn't fit the transmit buffer
+                                - the host times out traces that never come back
+                             */
+
+#endif
@@ -0,0 +1,111 @@
+"""  # Module docstring: low-latency camera capture used by ObjectDetection.py.
+Camera capture tuning
+
+Many USB webcams queue several frames inside the driver, so a plain cap.read() returns an image that is
+already a few frame periods old. This module:
+- opens the camera with an explicit backend (V4L2 on Linux, DSHOW/MSMF on Windows) and asks for
+  MJPG, a target FPS and a 1-frame driver buffer (drivers may ignore any of these, open_camera() reports what stuck);
+- FreshFrameReader grabs and discards frames that come out of the buffer instantly (they are stale),
+  and only decodes the one the camera had to wait for;
+- measure_capture_latency() estimates at startup how many frames the driver buffers and what that costs in ms.
+"""  # End of module docstring.
+
+import time  # Grab timing.
+import cv2  # type: ignore  # OpenCV capture API.
+
+BACKENDS = {  # --camera-backend names -> OpenCV API preference.
+    "auto": getattr(cv2, "CAP_ANY", 0),  # Let OpenCV choose.
+    "v4l2": getattr(cv2, "CAP_V4L2", 200),  # Linux, honours CAP_PROP_BUFFERSIZE.
+    "dshow": getattr(cv2, "CAP_DSHOW", 700),  # Windows DirectShow, allows MJPG on most webcams.
+    "msmf": getattr(cv2, "CAP_MSMF", 1400),  # Windows Media Foundation (OpenCV default on Windows).
+}  # End of backend table.
+
+
+def fourcc_code(fourcc):  # "MJPG" -> int.
+    """FOURCC string to the integer OpenCV expects"""  # Docstring.
+    return cv2.VideoWriter_fourcc(*fourcc[:4].ljust(4))  # Pad short codes with spaces.
+
+
+def fourcc_name(code):  # int -> "MJPG".
+    """Integer FOURCC reported by the driver back to its 4 letters"""  # Docstring.
+    code = int(code)  # Drivers report it as a float.
+    return "".join(chr((code >> (8 * i)) & 0xFF) for i in range(4)).strip("\x00 ") or "?"  # Little-endian letters.
+
+
+def open_camera(camera_id=0, backend="auto", fourcc="MJPG", width=640, height=480, fps=30, buffer_size=1):  # Configured capture.
+    """Open the camera with low-latency settings; returns the VideoCapture (check isOpened())
+
+    fourcc=None keeps the driver's pixel format, buffer_size=0 keeps its buffer depth."""  # Docstring.
+    if backend not in BACKENDS:  # Typo on the command line.
+        raise ValueError(f"camera backend must be one of {tuple(BACKENDS)}, got {backend!r}")  # Fail early.
+    cap = cv2.VideoCapture(camera_id, BACKENDS[backend])  # Explicit API preference.
+    if not cap.isOpened():  # Wrong id or backend not available in this OpenCV build.
+        return cap  # Caller reports the error.
+    if fourcc:  # MJPG first: it decides which resolutions and frame rates the camera offers over USB.
+        cap.set(cv2.CAP_PROP_FOURCC, fourcc_code(fourcc))  # Compressed stream, less USB bandwidth per frame.
+    cap.set(cv2.CAP_PROP_FRAME_WIDTH, width)  # Requested width.
+    cap.set(cv2.CAP_PROP_FRAME_HEIGHT, height)  # Requested height.
+    if fps:  # Target frame rate.
+        cap.set(cv2.CAP_PROP_FPS, fps)  # Shorter frame period, fresher frames.
+    if buffer_size:  # Driver queue depth.
+        cap.set(cv2.CAP_PROP_BUFFERSIZE, buffer_size)  # 1 = only the newest frame waits (backend permitting).
+    return cap  # Ready.
+
+
+def describe_camera(cap):  # What the driver reports after open_camera().
+    """One-line summary of the negotiated capture settings"""  # Docstring.
+    width = int(cap.get(cv2.CAP_PROP_FRAME_WIDTH))  # Actual width.
+    height = int(cap.get(cv2.CAP_PROP_FRAME_HEIGHT))  # Actual height.
+    fps = cap.get(cv2.CAP_PROP_FPS)  # Nominal frame rate (0 if unknown).
+    buffers = int(cap.get(cv2.CAP_PROP_BUFFERSIZE))  # Driver buffer depth (0 if unsupported).
+    return f"{fourcc_name(cap.get(cv2.CAP_PROP_FOURCC))} {width}x{height} @ {fps:.0f} fps, buffer {buffers or '?'}"  # Summary.
+
+
+class FreshFrameReader:  # Grab-and-discard reader.
+    """read() that skips frames the driver had already queued"""  # Docstring.
+
+    def __init__(self, cap, fps=30, max_discard=4):  # Capture and expected frame rate.
+        self.cap = cap  # Opened VideoCapture.
+        self.fresh_wait = 0.3 / max(1.0, fps)  # A grab that blocks this long waited for the sensor, so its frame is new.
+        self.max_discard = max_discard  # Upper bound on skipped frames per read (0 = plain read()).
+        self.discarded = 0  # Stale frames skipped so far (statistics).
+
+    def read(self, image=None):  # Same contract as cap.read().
+        """Return (ok, frame) with the freshest frame; image is decoded into if given"""  # Docstring.
+        for attempt in range(self.max_discard + 1):  # A few grabs at most, each one is cheap (no decoding).
+            start = time.monotonic()  # Time the grab.
+            if not self.cap.grab():  # Camera gone.
+                return False, None  # Same as a failed read().
+            if time.monotonic() - start >= self.fresh_wait or attempt == self.max_discard:  # Waited for it, or give up.
+                break  # Decode this one.
+            self.discarded += 1  # Came out of the queue instantly: stale, fetch the next.
+        if image is None:  # No buffer to reuse.
+            return self.cap.retrieve()  # Decode the grabbed frame.
+        return self.cap.retrieve(image)  # Decode in place.
+
+
+def measure_capture_latency(cap, settle=0.5, samples=20):  # Startup self-test.
+    """Estimate the frame period, the frames the driver buffers and the resulting capture latency
+
+    Reads samples frames to measure the real frame rate, then pauses for settle seconds so the driver queue
+    fills up and counts how many frames come out of it without waiting. Returns a dict or None if the camera failed."""  # Docstring.
+    for _ in range(3):  # Warm up: first frames often take much longer (exposure, USB negotiation).
+        if not cap.grab():  # No frames.
+            return None  # Nothing to measure.
+    start = time.monotonic()  # Steady state frame rate.
+    for _ in range(samples):  # Consecutive grabs.
+        if not cap.grab():  # Camera failed mid-test.
+            return None  # Nothing to report.
+    period = (time.monotonic() - start) / samples  # Seconds per frame.
+
+    time.sleep(settle)  # Pipeline stall: every driver buffer fills.
+    buffered = 0  # Frames that were already waiting.
+    for _ in range(16):  # Queues are never deeper than this in practice.
+        t0 = time.monotonic()  # Time the grab.
+        if not cap.grab():  # Camera failed mid-test.
+            return None  # Nothing to report.
+        if time.monotonic() - t0 >= 0.3 * period:  # Had to wait for the sensor: the queue is empty.
+            break  # Counted them all.
+        buffered += 1  # Stale frame.
+    latency = (buffered + 0.5) * period  # Age of a frame read after a stall: queued frames + half an exposure period.
+    return {"fps": 1.0 / period if period > 0 else 0.0, "buffered": buffered, "latency_ms": latency * 1000.0}  # Results.
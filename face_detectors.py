@@ -0,0 +1,286 @@
+#!/usr/bin/env python3  # Allow running the benchmark directly on Linux/macOS.
+# pyright: reportAttributeAccessIssue=false  # OpenCV's dynamic attributes often confuse type-checkers; runtime is fine.
+"""  # Module docstring: interchangeable face detector backends.
+Face detector backends used by ObjectDetection.py
+
+Every backend implements FaceDetector.detect(image, min_size, max_size) on a BGR image and returns
+a list of (x, y, w, h, score) boxes in image coordinates:
+- HaarDetector   : the original OpenCV Haar cascade (fast, no model download, more false positives)
+- YuNetDetector  : OpenCV DNN YuNet (cv2.FaceDetectorYN, needs face_detection_yunet_*.onnx)
+- SsdDetector    : OpenCV DNN ResNet-10 SSD (needs deploy.prototxt + res10_300x300_ssd_iter_140000.caffemodel)
+- HybridDetector : a cheap detector proposes faces, an expensive one confirms them on small crops
+
+DNN backends accept dnn_target = 'cpu', 'opencl', 'cuda' or 'openvino'.
+
+Run this file to benchmark latency against miss rate on a recorded clip:
+    python face_detectors.py --video clip.mp4 --backends haar,yunet,hybrid --yunet-model yunet.onnx
+"""  # End of module docstring.
+
+import argparse  # Benchmark command line.
+import time  # Latency measurement.
+import cv2  # type: ignore  # OpenCV detectors.
+from face_tracker import iou  # Box overlap for the duplicate filter.
+
+DNN_TARGETS = {  # Name -> (backend id, target id) for cv2.dnn.
+    'cpu': (cv2.dnn.DNN_BACKEND_OPENCV, cv2.dnn.DNN_TARGET_CPU),  # Portable default.
+    'opencl': (cv2.dnn.DNN_BACKEND_OPENCV, cv2.dnn.DNN_TARGET_OPENCL),  # Integrated GPUs.
+    'cuda': (cv2.dnn.DNN_BACKEND_CUDA, cv2.dnn.DNN_TARGET_CUDA),  # NVIDIA GPUs (OpenCV built with CUDA).
+    'openvino': (cv2.dnn.DNN_BACKEND_INFERENCE_ENGINE, cv2.dnn.DNN_TARGET_CPU),  # Intel CPUs/NPUs (OpenCV built with OpenVINO).
+}  # End target table.
+CROP_SIZES = (96, 160, 256, 384)  # Square confirmation crops of the hybrid detector (few sizes, few DNN input shapes).
+
+
+def box_size_ok(w, h, min_size, max_size):  # Shared size filter.
+    """True if a w x h box fits the requested size range"""  # Docstring.
+    return min_size <= max(w, h) <= max_size  # Compare the larger side.
+
+
+def crop_size(need):  # Quantized confirmation crop.
+    """Smallest CROP_SIZES entry that holds need pixels (multiples of the largest one beyond it)"""  # Docstring.
+    for size in CROP_SIZES:  # Smallest first.
+        if size >= need:  # Fits.
+            return size  # Quantized.
+    return -(-need // CROP_SIZES[-1]) * CROP_SIZES[-1]  # Huge faces: round up, still a small set.
+
+
+def suppress_duplicates(boxes, iou_threshold):  # Greedy NMS.
+    """Keep the best scoring box of every group overlapping by more than iou_threshold"""  # Docstring.
+    kept = []  # Survivors, best score first.
+    for box in sorted(boxes, key=lambda b: -b[4]):  # Highest score first.
+        if all(iou(box, k) <= iou_threshold for k in kept):  # Not a copy of a better box.
+            kept.append(box)  # New face.
+    return kept  # Duplicates gone.
+
+
+class FaceDetector:  # Backend interface.
+    """Base class: detect(image, min_size, max_size) -> list of (x, y, w, h, score)"""  # Docstring.
+
+    name = 'base'  # Short name used by the benchmark and the factory.
+    min_face_size = 1  # Smallest face (pixels) the backend can find.
+
+    def detect(self, image, min_size, max_size):  # Must be overridden.
+        """Return face boxes in image (BGR) whose size is between min_size and max_size"""  # Docstring.
+        raise NotImplementedError  # Abstract.
+
+
+class HaarDetector(FaceDetector):  # Original detector.
+    """OpenCV frontal-face Haar cascade"""  # Docstring.
+
+    name = 'haar'  # Factory name.
+    min_face_size = 24  # Training window of the cascade.
+
+    def __init__(self, cascade_path=None, scale_factor=1.1, min_neighbors=6):  # Same defaults as before.
+        path = cascade_path or cv2.data.haarcascades + 'haarcascade_frontalface_default.xml'  # Built into OpenCV.
+        self.cascade = cv2.CascadeClassifier(path)  # Load the classifier.
+        if self.cascade.empty():  # If the classifier failed to load.
+            raise RuntimeError(f"could not load Haar cascade {path}")  # Caller decides how to report it.
+        self.scale_factor = scale_factor  # Step between scales; smaller = slower but more accurate.
+        self.min_neighbors = min_neighbors  # Higher = fewer false positives.
+        self.gray = None  # Reused grayscale buffer (OpenCV reallocates it only when the image size changes).
+
+    def detect(self, image, min_size, max_size):  # Cascade search.
+        """Grayscale + equalize + detectMultiScale"""  # Docstring.
+        if min_size > max_size:  # Empty size range.
+            return []  # Nothing to search.
+        self.gray = cv2.cvtColor(image, cv2.COLOR_BGR2GRAY, dst=self.gray)  # Convert BGR image to grayscale.
+        gray = cv2.equalizeHist(self.gray, dst=self.gray)  # Enhance contrast in place, helps the cascade.
+        faces = self.cascade.detectMultiScale(  # Run multi-scale detection.
+            gray,  # Input image (grayscale).
+            scaleFactor=self.scale_factor,  # Scale step.
+            minNeighbors=self.min_neighbors,  # Neighbour threshold.
+            minSize=(min_size, min_size),  # Ignore tiny detections.
+            maxSize=(max_size, max_size),  # Ignore huge detections.
+            flags=cv2.CASCADE_SCALE_IMAGE  # Compatibility flag.
+        )  # End detectMultiScale.
+        return [(int(x), int(y), int(w), int(h), 1.0) for (x, y, w, h) in faces]  # The cascade gives no score.
+
+
+class YuNetDetector(FaceDetector):  # Lightweight CNN detector.
+    """OpenCV DNN YuNet face detector (cv2.FaceDetectorYN, OpenCV >= 4.5.4)"""  # Docstring.
+
+    name = 'yunet'  # Factory name.
+    min_face_size = 10  # YuNet finds much smaller faces than the cascade.
+
+    def __init__(self, model_path, score_threshold=0.7, nms_threshold=0.3, dnn_target='cpu'):  # Model + thresholds.
+        backend_id, target_id = DNN_TARGETS[dnn_target]  # Compute device.
+        self.net = cv2.FaceDetectorYN.create(model_path, "", (320, 320), score_threshold, nms_threshold, 50,  # Build the detector.
+                                             backend_id, target_id)  # Backend + target.
+        self.input_size = (320, 320)  # Current input size (changed only when the image size changes).
+
+    def detect(self, image, min_size, max_size):  # Single forward pass.
+        """Run YuNet on the whole image"""  # Docstring.
+        size = (image.shape[1], image.shape[0])  # (width, height).
+        if size != self.input_size:  # Reallocating the input is expensive, only do it on change.
+            self.net.setInputSize(size)  # Match the image.
+            self.input_size = size  # Remember it.
+        _, faces = self.net.detect(image)  # Nx15 rows: box, 5 landmarks, score.
+        if faces is None:  # No detection.
+            return []  # Empty list.
+        boxes = []  # Filtered boxes.
+        for row in faces:  # One face per row.
+            x, y, w, h = (int(v) for v in row[:4])  # Box.
+            if box_size_ok(w, h, min_size, max_size):  # Same size limits as the cascade.
+                boxes.append((max(0, x), max(0, y), w, h, float(row[14])))  # Clip to the image and keep the score.
+        return boxes  # Done.
+
+
+class SsdDetector(FaceDetector):  # Classic OpenCV DNN face model.
+    """OpenCV DNN ResNet-10 SSD face detector (Caffe model)"""  # Docstring.
+
+    name = 'ssd'  # Factory name.
+    min_face_size = 20  # Practical lower limit at 300x300 input.
+
+    def __init__(self, prototxt, caffemodel, score_threshold=0.6, dnn_target='cpu'):  # Model files + threshold.
+        self.net = cv2.dnn.readNetFromCaffe(prototxt, caffemodel)  # Load the network.
+        backend_id, target_id = DNN_TARGETS[dnn_target]  # Compute device.
+        self.net.setPreferableBackend(backend_id)  # Select backend.
+        self.net.setPreferableTarget(target_id)  # Select target.
+        self.score_threshold = score_threshold  # Minimum confidence.
+
+    def detect(self, image, min_size, max_size):  # Single forward pass at 300x300.
+        """Run the SSD on the image resized to 300x300"""  # Docstring.
+        h, w = image.shape[:2]  # Image size for scaling boxes back.
+        blob = cv2.dnn.blobFromImage(image, 1.0, (300, 300), (104.0, 177.0, 123.0))  # Mean-subtracted input.
+        self.net.setInput(blob)  # Feed the network.
+        out = self.net.forward()  # Shape 1x1xNx7.
+        boxes = []  # Filtered boxes.
+        for det in out[0, 0]:  # One candidate per row.
+            score = float(det[2])  # Confidence.
+            if score < self.score_threshold:  # Too uncertain.
+                continue  # Skip.
+            x0, y0 = int(det[3] * w), int(det[4] * h)  # Normalized -> pixels.
+            x1, y1 = int(det[5] * w), int(det[6] * h)  # Bottom-right corner.
+            if box_size_ok(x1 - x0, y1 - y0, min_size, max_size):  # Same size limits as the cascade.
+                boxes.append((max(0, x0), max(0, y0), x1 - x0, y1 - y0, score))  # Keep it.
+        return boxes  # Done.
+
+
+class HybridDetector(FaceDetector):  # Cheap proposals, expensive confirmation.
+    """Cheap detector proposes faces; the expensive one confirms each proposal on a padded crop"""  # Docstring.
+
+    name = 'hybrid'  # Factory name.
+
+    def __init__(self, cheap, expensive, padding=0.4, recheck_interval=15, confirm_factory=None, dedup_iou=0.3):  # Two backends.
+        self.cheap = cheap  # Runs on every frame (e.g. HaarDetector).
+        self.expensive = expensive  # Runs only on small crops (e.g. YuNetDetector).
+        self.padding = padding  # Crop margin around a proposal, fraction of its size.
+        self.recheck_interval = recheck_interval  # Full expensive pass every N empty frames (cheap misses).
+        self.confirm_factory = confirm_factory  # Builds one expensive detector per crop size (YuNet: fixed input shape each), None = share expensive.
+        self.confirmers = {}  # Crop size -> expensive detector built by confirm_factory.
+        self.dedup_iou = dedup_iou  # Confirmed boxes overlapping more than this are one face.
+        self.empty_frames = 0  # Consecutive frames where the cheap detector found nothing.
+        self.min_face_size = max(cheap.min_face_size, expensive.min_face_size)  # Both must be able to see it.
+
+    def confirmer(self, size):  # Expensive detector for one crop size.
+        """Detector that confirms size x size crops (created on first use when there is a factory)"""  # Docstring.
+        if self.confirm_factory is None:  # Shape-agnostic backend (SSD resizes to 300x300 anyway).
+            return self.expensive  # Shared.
+        if size not in self.confirmers:  # First crop of this size.
+            self.confirmers[size] = self.confirm_factory()  # Its input shape stays at size x size from now on.
+        return self.confirmers[size]  # Cached.
+
+    def detect(self, image, min_size, max_size):  # Gate + confirm.
+        """Return proposals of the cheap detector confirmed by the expensive one, without duplicates"""  # Docstring.
+        proposals = self.cheap.detect(image, min_size, max_size)  # Cheap pass over the whole image.
+        if not proposals:  # Nothing proposed.
+            self.empty_frames += 1  # Count misses of the cheap detector.
+            if self.empty_frames >= self.recheck_interval:  # Don't trust the cheap detector forever.
+                self.empty_frames = 0  # Restart the count.
+                return self.expensive.detect(image, min_size, max_size)  # Full expensive pass.
+            return []  # Accept the miss this frame.
+        self.empty_frames = 0  # Cheap detector is seeing faces.
+
+        confirmed = []  # Boxes both detectors agree on.
+        img_h, img_w = image.shape[:2]  # Bounds for the crops.
+        for (x, y, w, h, _score) in proposals:  # Check every proposal.
+            size = crop_size(int(max(w, h) * (1 + 2 * self.padding)))  # Padded proposal, quantized.
+            x0 = min(max(0, x + w // 2 - size // 2), max(0, img_w - size))  # Centered on the proposal, shifted inside the image.
+            y0 = min(max(0, y + h // 2 - size // 2), max(0, img_h - size))  # Same vertically.
+            crop = image[y0:y0 + size, x0:x0 + size]  # View, no copy.
+            if crop.shape[0] != size or crop.shape[1] != size:  # Image smaller than the crop.
+                crop = cv2.copyMakeBorder(crop, 0, size - crop.shape[0], 0, size - crop.shape[1], cv2.BORDER_CONSTANT)  # Pad bottom/right, offsets unchanged.
+            for (cx, cy, cw, ch, score) in self.confirmer(size).detect(crop, min_size, max_size):  # Confirm.
+                confirmed.append((cx + x0, cy + y0, cw, ch, score))  # Back to image coordinates (expensive box).
+        return suppress_duplicates(confirmed, self.dedup_iou)  # Overlapping crops confirm the same face once.
+
+
+def create_detector(name, yunet_model=None, ssd_prototxt=None, ssd_model=None, dnn_target='cpu'):  # Factory.
+    """Build a detector by name: 'haar', 'yunet', 'ssd', 'hybrid' (haar gating yunet, or ssd if no yunet model)"""  # Docstring.
+    if name == 'haar':  # Default backend.
+        return HaarDetector()  # No model files needed.
+    if name == 'yunet':  # DNN YuNet.
+        return YuNetDetector(yunet_model, dnn_target=dnn_target)  # Needs the onnx model.
+    if name == 'ssd':  # DNN SSD.
+        return SsdDetector(ssd_prototxt, ssd_model, dnn_target=dnn_target)  # Needs the Caffe files.
+    if name == 'hybrid':  # Cheap gate + expensive confirm.
+        if yunet_model:  # Prefer YuNet, one instance per crop size so setInputSize never runs on crops.
+            return HybridDetector(HaarDetector(), YuNetDetector(yunet_model, dnn_target=dnn_target),  # Full passes.
+                                  confirm_factory=lambda: YuNetDetector(yunet_model, dnn_target=dnn_target))  # Crops.
+        return HybridDetector(HaarDetector(), SsdDetector(ssd_prototxt, ssd_model, dnn_target=dnn_target))  # SSD input is fixed already.
+    raise ValueError(f"unknown detector backend {name!r}")  # Typo in configuration.
+
+
+def benchmark(detector, frames, min_size=40, max_size=400):  # Measure one backend.
+    """Return latency (mean/p95 ms) and miss rate of detector over frames that all contain a face"""  # Docstring.
+    latencies = []  # Per-frame detection time (ms).
+    misses = 0  # Frames without any detection.
+    for frame in frames:  # Same frames for every backend.
+        start = time.perf_counter()  # High resolution clock.
+        faces = detector.detect(frame, min_size, max_size)  # Detection under test.
+        latencies.append((time.perf_counter() - start) * 1000.0)  # Milliseconds.
+        if not faces:  # Face expected in every frame.
+            misses += 1  # Count the miss.
+    latencies.sort()  # For the percentile.
+    n = max(1, len(latencies))  # Avoid division by zero.
+    return {  # Summary.
+        'mean_ms': sum(latencies) / n,  # Average latency.
+        'p95_ms': latencies[min(len(latencies) - 1, int(0.95 * len(latencies)))] if latencies else 0.0,  # Tail latency.
+        'miss_rate': misses / n,  # Fraction of frames where the face was missed.
+    }  # End summary.
+
+
+def main():  # Benchmark entry point.
+    """Benchmark backends on a clip where a face is visible in every frame"""  # Docstring.
+    parser = argparse.ArgumentParser(description="Face detector latency / miss-rate benchmark")  # CLI.
+    parser.add_argument('--video', required=True, help="clip with a face in every frame")  # Input clip.
+    parser.add_argument('--backends', default='haar', help="comma separated: haar,yunet,ssd,hybrid")  # Backends.
+    parser.add_argument('--yunet-model', help="face_detection_yunet_*.onnx")  # YuNet model.
+    parser.add_argument('--ssd-prototxt', help="deploy.prototxt")  # SSD graph.
+    parser.add_argument('--ssd-model', help="res10_300x300_ssd_iter_140000.caffemodel")  # SSD weights.
+    parser.add_argument('--dnn-target', default='cpu', choices=sorted(DNN_TARGETS))  # Compute device.
+    parser.add_argument('--scale', type=float, default=0.5, help="detection scale (as in ObjectDetection.py)")  # Resize.
+    parser.add_argument('--max-frames', type=int, default=300)  # Clip length limit.
+    parser.add_argument('--max-miss-rate', type=float, default=0.05, help="miss-rate budget for the recommendation")  # Budget.
+    args = parser.parse_args()  # Parse.
+
+    cap = cv2.VideoCapture(args.video)  # Open the clip.
+    frames = []  # Decoded (and resized) frames, decoded once so decode time doesn't count.
+    while len(frames) < args.max_frames:  # Read up to the limit.
+        ret, frame = cap.read()  # Next frame.
+        if not ret:  # End of clip.
+            break  # Stop reading.
+        if args.scale != 1.0:  # Same resize as the host loop.
+            frame = cv2.resize(frame, None, fx=args.scale, fy=args.scale, interpolation=cv2.INTER_AREA)  # Shrink.
+        frames.append(frame)  # Keep it.
+    cap.release()  # Done with the clip.
+    print(f"{len(frames)} frames at scale {args.scale}")  # Report.
+
+    results = []  # (name, summary) per backend.
+    for name in args.backends.split(','):  # Each requested backend.
+        detector = create_detector(name.strip(), args.yunet_model, args.ssd_prototxt, args.ssd_model, args.dnn_target)  # Build.
+        if frames:  # Warm-up (model init, allocations) outside the measurement.
+            detector.detect(frames[0], 20, 400)  # Result ignored.
+        summary = benchmark(detector, frames)  # Measure.
+        results.append((name, summary))  # Keep it.
+        print(f"{name:8s} mean {summary['mean_ms']:7.2f} ms  p95 {summary['p95_ms']:7.2f} ms  miss {summary['miss_rate']:6.1%}")  # Row.
+
+    within = [r for r in results if r[1]['miss_rate'] <= args.max_miss_rate]  # Backends inside the budget.
+    if within:  # At least one qualifies.
+        best = min(within, key=lambda r: r[1]['mean_ms'])  # Fastest of them.
+        print(f"fastest within {args.max_miss_rate:.0%} miss budget: {best[0]}")  # Recommendation.
+    else:  # None qualifies.
+        print("no backend meets the miss-rate budget")  # Report.
+
+
+if __name__ == "__main__":  # Standard Python entry check.
+    main()  # Run the benchmark.
@@ -0,0 +1,165 @@
+"""  # Module docstring: face position trackers used by ObjectDetection.py.
+Predictive face tracking
+
+AlphaBetaTracker is a constant-velocity (alpha-beta) filter over (center_x, center_y, area):
+- O(1) state and work per update, no history buffer.
+- predict(t) extrapolates to a future time, so the control loop can aim where the face will be
+  once the serial link and the gait have reacted.
+- coast(t) keeps predicting through short detection dropouts and reports the track as lost
+  only after max_coast seconds without a measurement.
+
+MultiFaceTracker keeps an id for every face in view and locks onto one of them:
+- Detections are associated with tracks by IoU (bounding box overlap), greedily from the best overlap down;
+  with a handful of faces this is linear in the number of track/detection pairs, no assignment solver needed.
+- The target is the largest confirmed face when nothing is locked, and stays locked until its track is lost,
+  so a second person walking in doesn't make the robot turn back and forth.
+"""  # End of module docstring.
+
+
+class AlphaBetaTracker:  # Constant-velocity filter.
+    """Alpha-beta filter on a tuple of values (e.g. face center x, center y, area)"""  # Docstring.
+
+    def __init__(self, alpha=0.6, beta=0.2, max_coast=0.5):  # Filter gains and dropout tolerance.
+        self.alpha = alpha  # Position gain: 1 = trust the measurement, 0 = trust the prediction.
+        self.beta = beta  # Velocity gain.
+        self.max_coast = max_coast  # Seconds a track survives without measurements.
+        self.reset()  # Start without a track.
+
+    def reset(self):  # Forget the track.
+        """Drop the current track (next update starts a new one)"""  # Docstring.
+        self.state = None  # Filtered values.
+        self.velocity = None  # Rate of change per second.
+        self.last_time = None  # Time of the last update.
+
+    @property
+    def active(self):  # Track exists?
+        """True while a track is being followed"""  # Docstring.
+        return self.state is not None  # Set by the first update.
+
+    def update(self, measurement, t):  # Fold in one detection.
+        """Correct the track with a measurement taken at time t (seconds)"""  # Docstring.
+        if self.state is None:  # First measurement starts the track at rest.
+            self.state = list(measurement)  # Copy.
+            self.velocity = [0.0] * len(measurement)  # Unknown velocity.
+            self.last_time = t  # Remember time.
+            return  # Done.
+        dt = max(1e-3, t - self.last_time)  # Guard against equal timestamps.
+        for i, z in enumerate(measurement):  # Each value independently.
+            predicted = self.state[i] + self.velocity[i] * dt  # Constant velocity prediction.
+            residual = z - predicted  # Innovation.
+            self.state[i] = predicted + self.alpha * residual  # Corrected value.
+            self.velocity[i] += self.beta * residual / dt  # Corrected velocity.
+        self.last_time = t  # Remember time.
+
+    def predict(self, t):  # Extrapolate.
+        """Return the values expected at time t, or None without a track"""  # Docstring.
+        if self.state is None:  # No track.
+            return None  # Nothing to predict.
+        dt = t - self.last_time  # Time since the last update (may include the control lead time).
+        return tuple(s + v * dt for s, v in zip(self.state, self.velocity))  # Constant velocity.
+
+    def coast(self, t, lead=0.0):  # Predict without a measurement.
+        """Prediction at t + lead while the last measurement is at most max_coast old, else None (track lost)"""  # Docstring.
+        if self.state is None:  # No track.
+            return None  # Lost already.
+        if t - self.last_time > self.max_coast:  # Dropout too long to trust the model.
+            self.reset()  # Track lost.
+            return None  # Caller starts searching.
+        return self.predict(t + lead)  # Keep following the predicted face.
+
+
+def iou(a, b):  # Overlap of two (x, y, w, h) boxes.
+    """Intersection over union of two boxes, 0 when they don't overlap"""  # Docstring.
+    ix = min(a[0] + a[2], b[0] + b[2]) - max(a[0], b[0])  # Intersection width.
+    iy = min(a[1] + a[3], b[1] + b[3]) - max(a[1], b[1])  # Intersection height.
+    if ix <= 0 or iy <= 0:  # Disjoint.
+        return 0.0  # No overlap.
+    inter = ix * iy  # Intersection area.
+    return inter / float(a[2] * a[3] + b[2] * b[3] - inter)  # Union in the denominator.
+
+
+class FaceTrack:  # One face followed across frames.
+    """Last box and bookkeeping of one tracked face"""  # Docstring.
+    __slots__ = ('track_id', 'rect', 'last_seen', 'hits')  # Many are created, keep them small.
+
+    def __init__(self, track_id, rect, t):  # New track from an unmatched detection.
+        self.track_id = track_id  # Stable id while the face stays in view.
+        self.rect = rect  # Last detected (x, y, w, h).
+        self.last_seen = t  # Time of the last matched detection.
+        self.hits = 1  # Matched detections so far.
+
+
+class MultiFaceTracker:  # IoU tracker with target lock.
+    """Track every detected face with an id and keep one of them locked as the target"""  # Docstring.
+
+    def __init__(self, iou_threshold=0.3, max_age=0.5, min_hits=2):  # Association and lifetime settings.
+        self.iou_threshold = iou_threshold  # Minimum overlap for a detection to continue a track.
+        self.max_age = max_age  # Seconds a track survives without a matching detection.
+        self.min_hits = min_hits  # Detections before a new face can become the target (filters one-frame false positives).
+        self.tracks = {}  # track_id -> FaceTrack.
+        self.next_id = 1  # Id of the next new track.
+        self.target_id = None  # Locked track (None -> pick one on the next update).
+
+    def reset(self):  # Forget every face.
+        """Drop all tracks and the target lock"""  # Docstring.
+        self.tracks.clear()  # No faces.
+        self.target_id = None  # No lock.
+
+    def update(self, rects, t, region=None):  # Fold in the detections of one frame.
+        """Associate detections (x, y, w, h) found at time t; return the target box if it was detected, else None
+
+        region (x0, y0, x1, y1) is the part of the frame that was searched (None = whole frame);
+        tracks outside it are neither matched nor aged."""  # Docstring.
+        pairs = []  # (overlap, track_id, detection index) candidates.
+        for track in self.tracks.values():  # Every track ...
+            for i, rect in enumerate(rects):  # ... against every detection (a few faces at most).
+                overlap = iou(track.rect, rect)  # Box overlap.
+                if overlap >= self.iou_threshold:  # Plausibly the same face.
+                    pairs.append((overlap, track.track_id, i))  # Candidate.
+        pairs.sort(reverse=True)  # Best overlaps first.
+
+        matched_tracks = set()  # Tracks already continued.
+        matched_detections = set()  # Detections already used.
+        for _overlap, track_id, i in pairs:  # Greedy one-to-one matching.
+            if track_id in matched_tracks or i in matched_detections:  # Taken by a better pair.
+                continue  # Skip.
+            track = self.tracks[track_id]  # Matched track.
+            matched_tracks.add(track_id)  # Track consumed.
+            track.rect = rects[i]  # Follow the face.
+            track.last_seen = t  # Seen now.
+            track.hits += 1  # One more confirmation.
+            matched_detections.add(i)  # Detection consumed.
+
+        for i, rect in enumerate(rects):  # Detections nobody claimed.
+            if i not in matched_detections:  # New face in view.
+                self.tracks[self.next_id] = FaceTrack(self.next_id, rect, t)  # Start a track.
+                self.next_id += 1  # Ids are never reused.
+
+        for track_id in [k for k, track in self.tracks.items() if t - track.last_seen > self.max_age]:  # Expired tracks.
+            if region is None or self.inside(self.tracks[track_id].rect, region):  # It was searched for and not found.
+                del self.tracks[track_id]  # Face left the view.
+
+        if self.target_id not in self.tracks:  # Target lost (or none yet): lock onto the largest confirmed face.
+            confirmed = [track for track in self.tracks.values() if track.hits >= self.min_hits]  # Ignore one-frame blips.
+            self.target_id = max(confirmed, key=lambda tr: tr.rect[2] * tr.rect[3]).track_id if confirmed else None  # New lock.
+
+        target = self.tracks.get(self.target_id)  # Locked track, if any.
+        if target is None or target.last_seen != t:  # Not detected in this frame.
+            return None  # Caller coasts on its prediction.
+        return target.rect  # Box of the target in this frame.
+
+    def sees_target(self, rects):  # Read-only association test.
+        """True if one of the detections would continue the target track (nothing is updated or aged)"""  # Docstring.
+        target = self.tracks.get(self.target_id)  # Locked track, if any.
+        return target is not None and any(iou(target.rect, rect) >= self.iou_threshold for rect in rects)  # Same rule as update().
+
+    @property
+    def target(self):  # Locked track.
+        """FaceTrack of the target, or None"""  # Docstring.
+        return self.tracks.get(self.target_id)  # None without a lock.
+
+    @staticmethod
+    def inside(rect, region):  # Was this box within the searched region?
+        """True if the center of rect lies in region (x0, y0, x1, y1)"""  # Docstring.
+        cx, cy = rect[0] + rect[2] / 2.0, rect[1] + rect[3] / 2.0  # Box center.
+        return region[0] <= cx < region[2] and region[1] <= cy < region[3]  # Containment.
@@ -0,0 +1,170 @@
+"""  # Module docstring: end-to-end latency tracing from camera frame to servo write, used by ObjectDetection.py.
+Latency tracing of the control path
+
+A traced command carries the id of the camera frame it was decided from; the firmware echoes the id
+in OP_TRACE when the command reaches the servos. Each trace is split into stages:
+- capture:   cap.read() start -> frame decoded (includes the stale frames grabbed and dropped)
+- detect:    frame decoded -> face found (includes the wait for the detection thread)
+- decide:    face found -> command written to the serial port (decision, hand-off to the sender, dedup)
+- serial:    host write -> firmware handled the frame (estimated, see ClockSync)
+- firmware:  frame handled -> first servo write of the command (gait step boundary, loop period)
+- actuation: servo write -> pulse output (Timer1 backend only, otherwise unknown)
+
+Times are kept in seconds (time.monotonic()); histograms, CSV and the Chrome trace (chrome://tracing,
+ui.perfetto.dev) use milliseconds / microseconds as noted.
+"""  # End of module docstring.
+
+import collections  # Bounded record history and clock samples.
+import csv  # CSV export.
+import json  # Chrome trace export.
+
+STAGES = ('capture', 'detect', 'decide', 'serial', 'firmware', 'actuation')  # Order along the control path.
+HIST_EDGES_MS = (1, 2, 5, 10, 20, 50, 100, 200, 500)  # Upper bin edges, the last bin is everything above.
+TRACE_TIMEOUT = 2.0  # Seconds before a trace without OP_TRACE is dropped (replaced command, obstacle stop, lost frame).
+MAX_RECORDS = 20000  # Completed traces kept for export and percentiles (about 10 min of command changes).
+CLOCK_WINDOW = 32  # Traces in the clock offset window (follows the Arduino clock drift).
+US_WRAP = 1 << 32  # micros() wraps after about 71 minutes.
+
+
+class ClockSync:  # Maps Arduino micros() to host time.
+    """Offset between the Arduino clock and time.monotonic() from the traces themselves
+
+    host write <= firmware rx and firmware send <= host arrival, so each trace bounds the offset from both sides;
+    the tightest bounds over the last CLOCK_WINDOW traces are kept and the serial stage uses their midpoint
+    (one-way delay assumed symmetric, the host poll latency only widens the upper bound)."""  # Docstring.
+
+    def __init__(self, window=CLOCK_WINDOW):  # Empty window.
+        self.low = collections.deque(maxlen=window)  # host write - firmware rx: offset is at least this.
+        self.high = collections.deque(maxlen=window)  # host arrival - firmware send: offset is at most this.
+        self.last_us = None  # Last raw micros() value, for wrap detection.
+        self.wraps = 0  # micros() rollovers seen.
+
+    def seconds(self, us):  # Unwrapped Arduino time.
+        """Arduino micros() value in seconds since its reset, across rollovers"""  # Docstring.
+        if self.last_us is not None and self.last_us - us > US_WRAP // 2:  # Counter went back by more than half its range.
+            self.wraps += 1  # Rolled over.
+        self.last_us = us  # Remember.
+        return (us + self.wraps * US_WRAP) / 1e6  # Seconds.
+
+    def add(self, write_time, rx_s, send_s, arrival_time):  # One trace sample.
+        """Tighten the bounds with one trace (host times and unwrapped Arduino times in seconds)"""  # Docstring.
+        self.low.append(write_time - rx_s)  # The frame can't be handled before it was written.
+        self.high.append(arrival_time - send_s)  # The reply can't arrive before it was sent.
+
+    def offset(self):  # Best estimate.
+        """host time = Arduino time + offset"""  # Docstring.
+        low, high = max(self.low), min(self.high)  # Tightest bounds in the window.
+        return (low + high) / 2 if low <= high else high  # Bounds crossed by clock drift: trust the newest upper bound.
+
+
+class LatencyTracer:  # Correlates commands with their OP_TRACE replies.
+    """Per-stage latency of traced commands: histograms, summary and CSV / Chrome trace export"""  # Docstring.
+
+    def __init__(self):  # Empty tracer.
+        self.frame_id = 0  # Last frame id handed out.
+        self.pending = {}  # trace id -> record waiting for OP_TRACE.
+        self.records = collections.deque(maxlen=MAX_RECORDS)  # Completed records, oldest dropped first.
+        self.clock = ClockSync()  # Arduino -> host time.
+        self.hist = {stage: [0] * (len(HIST_EDGES_MS) + 1) for stage in STAGES}  # Counts per bin.
+        self.samples = {stage: collections.deque(maxlen=MAX_RECORDS) for stage in STAGES}  # Newest stage times in ms (percentiles).
+        self.completed = 0  # Traces finished during the run (records keeps only the newest).
+        self.timeouts = 0  # Traces that never came back.
+        self.t0 = None  # Time zero of the Chrome trace.
+
+    def next_id(self):  # Frame id counter.
+        """Id of the next camera frame (the low 16 bits travel as the trace id)"""  # Docstring.
+        self.frame_id += 1  # Never 0, so stale slots are easy to spot.
+        return self.frame_id  # New id.
+
+    def start(self, stamp, command, speed, write_time, expect_reply=True):  # Command written.
+        """Begin a trace; stamp holds the host times of the frame (frame_id, read_start, capture_time, detect_done)
+
+        Without expect_reply (simulation mode) only the host stages are recorded."""  # Docstring.
+        record = dict(stamp, command=command, speed=speed, write_time=write_time)  # Host side of the trace.
+        if self.t0 is None:  # First trace.
+            self.t0 = stamp['read_start']  # Chrome trace starts here.
+        if not expect_reply:  # Nobody answers.
+            self.finish(record)  # Host stages only.
+            return  # Done.
+        self.expire(write_time)  # Drop old traces first so the dict stays small.
+        self.pending[stamp['frame_id'] & 0xFFFF] = record  # A reused id replaces a trace that was lost anyway.
+
+    def complete(self, reply, arrival_time):  # OP_TRACE arrived.
+        """Finish the trace a parse_trace() reply belongs to; False if it is unknown (timed out, another host run)"""  # Docstring.
+        record = self.pending.pop(reply['trace_id'], None)  # Matching command.
+        if record is None:  # Nothing waiting.
+            return False  # Ignored.
+        rx_s = self.clock.seconds(reply['rx_us'])  # Handled, Arduino clock.
+        self.clock.add(record['write_time'], rx_s, rx_s + reply['queue_us'] / 1e6, arrival_time)  # OP_TRACE left at the servo write.
+        record['rx_time'] = max(record['write_time'], rx_s + self.clock.offset())  # Host time, never before the write.
+        record['servo_time'] = record['rx_time'] + reply['queue_us'] / 1e6  # First servo write.
+        record['output_time'] = None if reply['output_us'] is None else record['servo_time'] + reply['output_us'] / 1e6  # Pulse out.
+        self.finish(record)  # Stages and histograms.
+        return True  # Matched.
+
+    def expire(self, now):  # Forget traces that will never complete.
+        """Drop pending traces older than TRACE_TIMEOUT"""  # Docstring.
+        for trace_id in [i for i, r in self.pending.items() if now - r['write_time'] > TRACE_TIMEOUT]:  # Old ones.
+            del self.pending[trace_id]  # Replaced before a servo write, stopped by an obstacle or lost.
+            self.timeouts += 1  # Reported in the summary.
+
+    @staticmethod
+    def stages(record):  # Split one record.
+        """Return {stage: (start time, duration s)} for the stages the record has"""  # Docstring.
+        points = [record['read_start'], record['capture_time'], record['detect_done'], record['write_time'],  # Host side.
+                  record.get('rx_time'), record.get('servo_time'), record.get('output_time')]  # Firmware side (None if unknown).
+        return {stage: (points[i], points[i + 1] - points[i]) for i, stage in enumerate(STAGES)  # Consecutive points.
+                if points[i] is not None and points[i + 1] is not None}  # Only stages with both ends.
+
+    def finish(self, record):  # Account one complete record.
+        """Add the record to the history and its stages to the histograms"""  # Docstring.
+        self.records.append(record)  # For export.
+        self.completed += 1  # Whole run.
+        for stage, (_start, duration) in self.stages(record).items():  # Each known stage.
+            ms = duration * 1000  # Milliseconds.
+            self.samples[stage].append(ms)  # Percentiles.
+            self.hist[stage][sum(1 for edge in HIST_EDGES_MS if ms > edge)] += 1  # Bin index = edges below the value.
+
+    def summary(self):  # Text report.
+        """Lines with count, percentiles and histogram of every stage, biggest median first
+
+        Percentiles cover the newest MAX_RECORDS traces, the histograms every trace of the run."""  # Docstring.
+        lines = [f"[TRACE] {self.completed} traces, {self.timeouts} timed out, {len(self.pending)} pending"]  # Header.
+        bins = [f"<={edge}" for edge in HIST_EDGES_MS] + [f">{HIST_EDGES_MS[-1]}"]  # Bin labels (ms).
+        lines.append("[TRACE] stage      n      p50ms   p95ms   maxms   | " + " ".join(f"{b:>6s}" for b in bins))  # Column titles.
+        ranked = sorted((s for s in STAGES if self.samples[s]), key=lambda s: -percentile(self.samples[s], 50))  # Biggest first.
+        for stage in ranked:  # One line per stage.
+            v = self.samples[stage]  # Milliseconds.
+            lines.append(f"[TRACE] {stage:10s} {sum(self.hist[stage]):<6d} {percentile(v, 50):7.1f} {percentile(v, 95):7.1f} {max(v):7.1f} | "  # Stats.
+                         + " ".join(f"{n:6d}" for n in self.hist[stage]))  # Histogram.
+        return lines  # Caller prints.
+
+    def export_csv(self, path):  # One row per trace.
+        """Write every completed trace with its stage times in ms (empty = unknown)"""  # Docstring.
+        with open(path, "w", newline="") as f:  # Overwrite.
+            writer = csv.writer(f)  # Default dialect.
+            writer.writerow(['frame_id', 'command', 'speed', 'capture_time'] + [f"{s}_ms" for s in STAGES] + ['total_ms'])  # Header.
+            for record in self.records:  # Oldest first.
+                stages = self.stages(record)  # Known stages.
+                end = record.get('output_time') or record.get('servo_time') or record['write_time']  # Last known point.
+                writer.writerow([record['frame_id'], record['command'], record['speed'], f"{record['capture_time']:.6f}"]  # Identity.
+                                + [f"{stages[s][1] * 1000:.3f}" if s in stages else "" for s in STAGES]  # Stage times.
+                                + [f"{(end - record['read_start']) * 1000:.3f}"])  # Frame read to the last known point.
+
+    def export_chrome(self, path):  # Chrome trace event format.
+        """Write the traces as complete ("X") events, one track per stage (open in chrome://tracing or Perfetto)"""  # Docstring.
+        events = [{'name': 'thread_name', 'ph': 'M', 'pid': 1, 'tid': i, 'args': {'name': stage}}  # Track names.
+                  for i, stage in enumerate(STAGES)]  # One track per stage.
+        for record in self.records:  # Oldest first.
+            args = {'frame_id': record['frame_id'], 'command': record['command'], 'speed': record['speed']}  # Shown on click.
+            for stage, (start, duration) in self.stages(record).items():  # Known stages.
+                events.append({'name': f"{stage} {record['command']}", 'ph': 'X', 'pid': 1, 'tid': STAGES.index(stage),  # Slice.
+                               'ts': round((start - self.t0) * 1e6), 'dur': round(duration * 1e6), 'args': args})  # Microseconds.
+        with open(path, "w") as f:  # Overwrite.
+            json.dump({'traceEvents': events, 'displayTimeUnit': 'ms'}, f)  # Object form.
+
+
+def percentile(values, p):  # Nearest-rank percentile.
+    """p-th percentile of a non-empty list"""  # Docstring.
+    ordered = sorted(values)  # Copy.
+    return ordered[min(len(ordered) - 1, int(len(ordered) * p / 100))]  # Nearest rank.
@@ -0,0 +1,81 @@
+"""  # Module docstring: MJPEG preview server used by ObjectDetection.py.
+MJPEG preview over HTTP
+
+For robots without a monitor: the newest JPEG frame is served as a multipart/x-mixed-replace stream,
+which any browser shows as live video (http://<robot>:<port>/).
+- publish() only swaps a reference, so the tracking pipeline never waits for a viewer.
+- Every client gets its own server thread and always the newest frame; slow clients skip frames.
+"""  # End of module docstring.
+
+import threading  # Frame hand-off between publisher and client threads.
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer  # Standard library HTTP server.
+
+BOUNDARY = b"frame"  # Multipart boundary between JPEG images.
+
+
+class MjpegStreamer:  # Serves the newest frame to any number of clients.
+    """Minimal MJPEG server: publish(jpeg_bytes) from the preview thread, browsers connect to /"""  # Docstring.
+
+    def __init__(self, port=8080, host="0.0.0.0"):  # Listen address.
+        self.address = (host, port)  # Where the server listens.
+        self.cond = threading.Condition()  # Protects jpeg/version and wakes client threads.
+        self.jpeg = None  # Newest encoded frame.
+        self.version = 0  # Incremented on every publish().
+        self.running = False  # False tells client threads to finish.
+        self.server = None  # ThreadingHTTPServer once started.
+
+    def start(self):  # Begin serving.
+        """Start the HTTP server on a background thread"""  # Docstring.
+        streamer = self  # Captured by the handler class.
+
+        class Handler(BaseHTTPRequestHandler):  # One instance per request.
+            def do_GET(self):  # Only GET is supported.
+                if self.path not in ("/", "/stream.mjpg"):  # Anything else.
+                    self.send_error(404)  # Not found.
+                    return  # Done.
+                self.send_response(200)  # Start the stream.
+                self.send_header("Content-Type", "multipart/x-mixed-replace; boundary=" + BOUNDARY.decode())  # MJPEG.
+                self.send_header("Cache-Control", "no-cache")  # Always live.
+                self.end_headers()  # Headers done.
+                streamer.serve_client(self.wfile)  # Stream until the client leaves or the server stops.
+
+            def log_message(self, *args):  # Default handler logs every request to stderr.
+                pass  # Keep the console for tracking output.
+
+        self.server = ThreadingHTTPServer(self.address, Handler)  # One thread per client.
+        self.server.daemon_threads = True  # Don't keep the process alive for viewers.
+        self.running = True  # Clients may stream.
+        threading.Thread(target=self.server.serve_forever, name="mjpeg", daemon=True).start()  # Accept clients.
+        print(f"✓ MJPEG preview on http://{self.address[0]}:{self.address[1]}/")  # Tell the user where to look.
+
+    def publish(self, jpeg):  # New frame from the preview thread.
+        """Replace the frame sent to clients (never blocks on slow clients)"""  # Docstring.
+        with self.cond:  # Exclusive access.
+            self.jpeg = jpeg  # Newest frame.
+            self.version += 1  # New version.
+            self.cond.notify_all()  # Wake client threads.
+
+    def serve_client(self, out):  # Runs on the client's server thread.
+        """Write every new frame to one client until it disconnects or the server stops"""  # Docstring.
+        seen = 0  # Version last sent to this client.
+        while self.running:  # Until stop().
+            with self.cond:  # Exclusive access.
+                if not self.cond.wait_for(lambda: self.version != seen or not self.running, timeout=1.0):  # Nothing new.
+                    continue  # Check running again.
+                jpeg, seen = self.jpeg, self.version  # Newest frame.
+            if jpeg is None:  # Woken by stop() before any frame.
+                continue  # Loop ends on running.
+            try:  # The client may go away at any time.
+                out.write(b"--" + BOUNDARY + b"\r\nContent-Type: image/jpeg\r\nContent-Length: "  # Part header.
+                          + str(len(jpeg)).encode() + b"\r\n\r\n" + jpeg + b"\r\n")  # JPEG data.
+            except (BrokenPipeError, ConnectionResetError):  # Viewer closed the page.
+                return  # Free the thread.
+
+    def stop(self):  # Shut the server down.
+        """Stop accepting clients and end all streams"""  # Docstring.
+        with self.cond:  # Exclusive access.
+            self.running = False  # Client loops finish.
+            self.cond.notify_all()  # Wake them now.
+        if self.server:  # Started?
+            self.server.shutdown()  # Stop serve_forever().
+            self.server.server_close()  # Release the port.
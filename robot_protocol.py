@@ -0,0 +1,221 @@
+"""  # Module docstring: host side of the binary serial protocol (mirror of Protocol.h).
+Binary serial frames shared by ObjectDetection.py and the Arduino firmware.
+
+Frame layout:
+    [SYNC 0xA5] [opcode] [seq] [len] [payload 0..MAX_PAYLOAD bytes] [crc8]
+
+- crc8 covers opcode, seq, len and payload (polynomial 0x07, initial value 0).
+- Multi-byte payload values are little endian.
+- Once an OP_HEARTBEAT arrived, the robot stops by itself if no command or heartbeat renews the lease in time.
+- The firmware streams OP_TELEMETRY records (command, gait state, distance, obstacle flag) on its own.
+- A command may carry a trace id; the firmware echoes it in OP_TRACE when the command reaches the servos.
+- Several frames can be concatenated and sent in ONE serial write (batching);
+  the firmware drains the whole UART buffer every loop and applies only the newest command.
+"""  # End of module docstring.
+
+import struct  # Packs payload values into little-endian bytes.
+
+SYNC = 0xA5  # First byte of every frame.
+MAX_PAYLOAD = 16  # Must match PROTO_MAX_PAYLOAD in Protocol.h.
+PROTO_VERSION = 3  # Must match PROTO_VERSION in Protocol.h (reported in OP_READY); 2: telemetry step index, B/G commands.
+TRACE_MIN_VERSION = 3  # First firmware protocol version that answers traced commands with OP_TRACE.
+
+OP_CMD = 0x01  # Payload: command letter 'F', 'B', 'L', 'R', 'G' or 'S', optional speed 1..100, optional trace id (uint16).
+OP_GAIT_TIMING = 0x02  # Payload: gait id, motion time ms (uint16), stop time ms (uint16).
+OP_GAIT_PRESET = 0x03  # Payload: gait id, preset.
+OP_GAIT_SAVE = 0x04  # No payload: persist the gait table in EEPROM.
+OP_STATS_REQ = 0x05  # Payload: optional reset flag.
+OP_TELEM_RATE = 0x06  # Payload: telemetry period ms (uint16), 0 = off.
+OP_HEARTBEAT = 0x07  # Payload: lease ms (uint16); arms/renews the command lease.
+OP_GAIT_STEPS = 0x08  # Payload: first index, total steps, up to 4 steps (leg, speed %, duration).
+
+OP_STATS_SECTION = 0x81  # Reply: section, count (uint32), min/avg/max us (uint16).
+OP_STATS_COUNTERS = 0x82  # Reply: one uint16 per counter.
+OP_TELEMETRY = 0x83  # Stream: millis, command, speed, gait, gait state, distance mm, flags.
+OP_READY = 0x84  # Sent once by setup(): protocol version.
+OP_TRACE = 0x85  # Reply to a traced OP_CMD: trace id, rx micros (uint32), us to the servo write (uint32), us to the pulse (uint16).
+
+STATS_SECTIONS = ('serial', 'ranging', 'dispatch', 'loop', 'cmd_latency', 'sleep', 'wake_latency')  # ProfSection order in Profiler.h.
+STATS_COUNTERS = ('range_timeouts', 'forced_stops', 'bad_frames', 'range_outliers', 'telem_dropped', 'lease_expired')  # ProfCounter order in Profiler.h.
+
+GAIT_FORWARD = 0  # Gait ids (GaitId in GaitParams.h).
+GAIT_LEFT = 1  # Rotate left.
+GAIT_RIGHT = 2  # Rotate right.
+GAIT_ALL = 0xFF  # Addresses every gait.
+
+PRESET_STABLE = 0  # Long slow steps (GaitPreset in GaitParams.h).
+PRESET_NORMAL = 1  # Original 500 ms / 250 ms timing.
+PRESET_FAST = 2  # Short steps, most steps per second.
+
+TELEM_OBSTACLE = 0x01  # Telemetry flags (Telemetry.h): the last moving command was replaced by 'S', a collision is predicted on its path.
+TELEM_STOPPED = 0x02  # Legs stopped.
+TELEM_IDLE = 0x04  # Legs detached, low-power idle.
+TELEM_LEASE = 0x08  # Stopped because the command lease expired.
+LEASE_MS = 500  # Default command lease (PROTO_LEASE_MS in Protocol.h).
+GAIT_NAMES = ('none', 'move', 'rotate', 'backward', 'custom')  # Gait enum order in Robot.h.
+
+COMMANDS = ('F', 'B', 'L', 'R', 'G', 'S')  # Valid movement commands ('B' backward, 'G' the gait loaded with gait_steps()).
+
+RIGHT_LEG = 1  # Step legs (Robot.h).
+LEFT_LEG = 2  # Left servo.
+NO_LEG = 0  # Pause step, no servo write.
+STEP_MOTION = 0xFF  # Step duration: the gait's motion time.
+STEP_STOP = 0xFE  # Step duration: the gait's stop time.
+STEP_TICK_MS = 10  # Other durations are multiples of this.
+GAIT_SLOT_STEPS = 12  # Steps in the firmware's RAM gait slot (GaitParams.h).
+STEPS_PER_FRAME = 4  # Steps that fit in one OP_GAIT_STEPS payload.
+SPEED_MAX = 100  # Full leg speed (SPEED_MAX in Robot.h).
+SERVO_DELAY_UNKNOWN = 0xFFFF  # OP_TRACE output delay when the servo backend can't tell (Robot.h).
+
+
+def crc8(data, crc=0):  # CRC-8 with polynomial 0x07, same as crc8() in Protocol.cpp.
+    """Return the crc8 of data (bytes), continuing from crc."""  # Docstring.
+    for byte in data:  # Process one byte at a time.
+        crc ^= byte  # Mix the byte in.
+        for _ in range(8):  # Shift out 8 bits.
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF  # Polynomial division step.
+    return crc  # Final checksum.
+
+
+class FrameEncoder:  # Builds frames and keeps the sequence number.
+    """Encode protocol frames with an incrementing 8-bit sequence number"""  # Docstring.
+
+    def __init__(self):  # Constructor.
+        self.seq = 0  # Sequence number of the next frame (wraps at 256).
+
+    def encode(self, opcode, payload=b''):  # Build one frame.
+        """Return the bytes of one frame"""  # Docstring.
+        if len(payload) > MAX_PAYLOAD:  # Firmware drops oversized frames anyway.
+            raise ValueError(f"payload too long ({len(payload)} > {MAX_PAYLOAD})")  # Fail loudly on the host.
+        header = bytes((opcode, self.seq, len(payload)))  # opcode, seq, len.
+        self.seq = (self.seq + 1) & 0xFF  # Advance and wrap the sequence number.
+        body = header + bytes(payload)  # Bytes covered by the crc.
+        return bytes((SYNC,)) + body + bytes((crc8(body),))  # Complete frame.
+
+    def command(self, command, speed=SPEED_MAX, trace_id=None):  # Movement command frame.
+        """Frame for a movement command ('F', 'B', 'L', 'R', 'G' or 'S') at speed 1..100 percent
+
+        With a trace_id the firmware answers OP_TRACE once the command reaches the servos."""  # Docstring.
+        if command not in COMMANDS:  # Only valid commands are framed.
+            raise ValueError(f"invalid command {command!r}")  # Programming error.
+        speed = max(1, min(SPEED_MAX, int(speed)))  # Firmware ignores values outside 1..100.
+        payload = command.encode() + bytes((speed,))  # Letter + speed.
+        if trace_id is not None:  # Traced command.
+            payload += struct.pack('<H', trace_id & 0xFFFF)  # uint16 id, wraps.
+        return self.encode(OP_CMD, payload)  # Command frame.
+
+    def gait_timing(self, motion_ms, stop_ms, gait=GAIT_ALL):  # Gait timing frame.
+        """Frame that changes the step timings of one gait (or all of them)"""  # Docstring.
+        return self.encode(OP_GAIT_TIMING, struct.pack('<BHH', gait, motion_ms, stop_ms))  # Gait id + two uint16 values.
+
+    def gait_preset(self, preset, gait=GAIT_ALL):  # Gait preset frame.
+        """Frame that switches one gait (or all of them) to a speed preset"""  # Docstring.
+        return self.encode(OP_GAIT_PRESET, bytes((gait, preset)))  # Gait id + preset.
+
+    def gait_save(self):  # EEPROM save frame.
+        """Frame that persists the current gait table on the Arduino"""  # Docstring.
+        return self.encode(OP_GAIT_SAVE)  # No payload.
+
+    def gait_steps(self, steps):  # Custom gait upload.
+        """Frames that load a step table [(leg, speed -100..100, duration)] into the RAM slot run by 'G'
+
+        duration is STEP_MOTION, STEP_STOP or a multiple of STEP_TICK_MS in ms; send all frames in order."""  # Docstring.
+        if not 0 < len(steps) <= GAIT_SLOT_STEPS:  # Firmware rejects empty or oversized tables.
+            raise ValueError(f"a gait has 1..{GAIT_SLOT_STEPS} steps, got {len(steps)}")  # Programming error.
+        frames = []  # One frame per chunk.
+        for start in range(0, len(steps), STEPS_PER_FRAME):  # Chunks of 4 steps.
+            payload = bytes((start, len(steps)))  # First index and table size.
+            for leg, speed, duration in steps[start:start + STEPS_PER_FRAME]:  # Each step.
+                if duration not in (STEP_MOTION, STEP_STOP):  # Explicit time in ms.
+                    duration = max(1, min(0xFD, int(round(duration / STEP_TICK_MS))))  # Ticks, below the two markers.
+                payload += struct.pack('<BbB', leg, max(-100, min(100, int(speed))), duration)  # 3 bytes per step.
+            frames.append(self.encode(OP_GAIT_STEPS, payload))  # Chunk frame.
+        return frames  # Slot becomes valid with the last one.
+
+    def stats_request(self, reset=False):  # Profiling dump request.
+        """Frame that asks the Arduino for its loop timing statistics"""  # Docstring.
+        return self.encode(OP_STATS_REQ, bytes((1 if reset else 0,)))  # Optional reset after the dump.
+
+    def heartbeat(self, lease_ms=LEASE_MS):  # Keepalive frame.
+        """Frame that renews the command lease; the robot stops if none (or no command) arrives within lease_ms"""  # Docstring.
+        return self.encode(OP_HEARTBEAT, struct.pack('<H', max(0, min(0xFFFF, int(lease_ms)))))  # uint16 lease, 0 = no lease.
+
+    def telemetry_rate(self, period_ms):  # Telemetry period frame.
+        """Frame that sets the time between periodic telemetry records (0 turns telemetry off)"""  # Docstring.
+        return self.encode(OP_TELEM_RATE, struct.pack('<H', max(0, min(0xFFFF, int(period_ms)))))  # uint16 period.
+
+
+class FrameDecoder:  # Incremental parser for frames coming from the Arduino.
+    """Feed raw serial bytes, get complete (opcode, seq, payload) tuples back"""  # Docstring.
+
+    def __init__(self):  # Constructor.
+        self.buffer = bytearray()  # Bytes not yet forming a complete frame.
+        self.bad_frames = 0  # Frames dropped because of a bad crc or length.
+
+    def feed(self, data):  # Add bytes and extract frames.
+        """Return the list of valid frames completed by data"""  # Docstring.
+        self.buffer += data  # Append new bytes.
+        frames = []  # Frames found in this call.
+        while True:  # Extract as many frames as possible.
+            start = self.buffer.find(SYNC)  # Look for the next sync byte.
+            if start < 0:  # No frame start at all.
+                self.buffer.clear()  # Nothing worth keeping (firmware sends no ASCII).
+                return frames  # Done.
+            del self.buffer[:start]  # Drop garbage before the sync byte.
+            if len(self.buffer) < 4:  # Header incomplete.
+                return frames  # Wait for more bytes.
+            length = self.buffer[3]  # Payload length.
+            if length > MAX_PAYLOAD:  # Cannot be a real frame.
+                self.bad_frames += 1  # Count it.
+                del self.buffer[0]  # Resync after this sync byte.
+                continue  # Try again.
+            if len(self.buffer) < length + 5:  # Frame incomplete.
+                return frames  # Wait for more bytes.
+            body = bytes(self.buffer[1:4 + length])  # opcode, seq, len, payload.
+            if crc8(body) != self.buffer[4 + length]:  # Corrupted frame.
+                self.bad_frames += 1  # Count it.
+                del self.buffer[0]  # Resync after this sync byte.
+                continue  # Try again.
+            frames.append((body[0], body[1], body[3:]))  # (opcode, seq, payload).
+            del self.buffer[:length + 5]  # Consume the frame.
+
+
+def parse_stats_section(payload):  # Decode an OP_STATS_SECTION payload.
+    """Return (section_name, dict of count/min/avg/max in microseconds)"""  # Docstring.
+    section, count, min_us, avg_us, max_us = struct.unpack('<BIHHH', payload[:11])  # Fixed layout.
+    name = STATS_SECTIONS[section] if section < len(STATS_SECTIONS) else f"section{section}"  # Unknown sections stay readable.
+    return name, {'count': count, 'min_us': min_us, 'avg_us': avg_us, 'max_us': max_us}  # Named fields.
+
+
+def parse_stats_counters(payload):  # Decode an OP_STATS_COUNTERS payload.
+    """Return a dict of counter name -> value"""  # Docstring.
+    values = struct.unpack(f'<{len(payload) // 2}H', payload[:len(payload) // 2 * 2])  # All uint16.
+    return {STATS_COUNTERS[i] if i < len(STATS_COUNTERS) else f"counter{i}": v for i, v in enumerate(values)}  # Named values.
+
+
+def parse_telemetry(payload):  # Decode an OP_TELEMETRY payload.
+    """Return a dict with the state the firmware is really executing"""  # Docstring.
+    t_ms, cmd, speed, gait, state, distance_mm, flags = struct.unpack('<IBBBBhB', payload[:11])  # Fixed layout.
+    return {  # Named fields.
+        't_ms': t_ms,  # Arduino millis() of the record.
+        'cmd': chr(cmd) if cmd else None,  # Command letter (None before the first command).
+        'speed': speed,  # Leg speed percent.
+        'gait': GAIT_NAMES[gait] if gait < len(GAIT_NAMES) else f"gait{gait}",  # Gait of the last servo write.
+        'state': state,  # Step index in the gait's step table.
+        'distance_cm': distance_mm / 10.0 if distance_mm >= 0 else None,  # Filtered distance, None = nothing in range.
+        'obstacle': bool(flags & TELEM_OBSTACLE),  # Firmware is forcing a stop.
+        'stopped': bool(flags & TELEM_STOPPED),  # Legs stopped.
+        'idle': bool(flags & TELEM_IDLE),  # Low-power idle.
+        'lease_expired': bool(flags & TELEM_LEASE),  # Stopped by the failsafe.
+    }  # End of record.
+
+
+def parse_trace(payload):  # Decode an OP_TRACE payload.
+    """Return a dict with the firmware side timestamps of a traced command"""  # Docstring.
+    trace_id, rx_us, queue_us, output_us = struct.unpack('<HIIH', payload[:12])  # Fixed layout.
+    return {  # Named fields.
+        'trace_id': trace_id,  # Id sent with the OP_CMD.
+        'rx_us': rx_us,  # Arduino micros() when the command was handled.
+        'queue_us': queue_us,  # Until the first servo write of the command.
+        'output_us': None if output_us == SERVO_DELAY_UNKNOWN else output_us,  # Until that pulse is output (None = unknown).
+    }  # End of record.
@@ -0,0 +1,86 @@
+"""  # Module docstring: Arduino port discovery and startup handshake used by ObjectDetection.py.
+Arduino serial link setup
+
+- find_arduino_ports() lists serial ports whose USB VID/PID belongs to an Arduino or a common USB-serial bridge.
+  It never opens a port, so nothing is reset by DTR while searching.
+- The last port that completed the handshake is cached and tried first on the next start.
+- wait_ready() replaces the fixed sleep after opening the port: the firmware sends OP_READY at the end of setup(),
+  so the host continues as soon as the Arduino has rebooted (old firmware without OP_READY falls back to the timeout).
+"""  # End of module docstring.
+
+import json  # Port cache file format.
+import os  # Cache file location.
+import time  # Handshake timeout.
+from robot_protocol import FrameDecoder, OP_READY, PROTO_VERSION  # Ready frame.
+
+try:  # pyserial ships list_ports, but keep discovery optional.
+    from serial.tools import list_ports  # USB descriptors of the serial ports.
+except ImportError:  # Very old or stripped pyserial.
+    list_ports = None  # Discovery falls back to the cache only.
+
+USB_IDS = {  # (VID, PID or None for any) -> board name.
+    (0x2341, None): "Arduino",  # Arduino LLC boards (UNO, Mega, Leonardo ...).
+    (0x2A03, None): "Arduino.org",  # Arduino SRL boards.
+    (0x1A86, 0x7523): "CH340",  # Clone boards.
+    (0x0403, 0x6001): "FTDI FT232",  # Older boards and FTDI cables.
+    (0x10C4, 0xEA60): "CP210x",  # Silicon Labs bridges.
+}  # End of USB table.
+
+CACHE_PATH = os.path.join(os.path.expanduser("~"), ".face_tracking_robot.json")  # Last good port.
+READY_TIMEOUT = 3.0  # Seconds to wait for OP_READY (bootloader + setup() take about 1-2 s on an UNO).
+
+
+def board_name(port_info):  # Match one list_ports entry.
+    """Name of the board behind a list_ports entry, or None if its VID/PID is unknown"""  # Docstring.
+    if port_info.vid is None:  # Not a USB device (built-in UART, Bluetooth ...).
+        return None  # Never an Arduino here.
+    return USB_IDS.get((port_info.vid, port_info.pid)) or USB_IDS.get((port_info.vid, None))  # Exact PID, then any PID.
+
+
+def load_cached_port(path=CACHE_PATH):  # Read the cache.
+    """Port that last completed the handshake, or None"""  # Docstring.
+    try:  # Missing or corrupt cache is not an error.
+        with open(path) as f:  # Small JSON file.
+            return json.load(f).get("port")  # Cached name.
+    except (OSError, ValueError, AttributeError):  # No cache yet, bad JSON or not a dict.
+        return None  # Nothing cached.
+
+
+def save_cached_port(port, path=CACHE_PATH):  # Write the cache.
+    """Remember port for the next start (errors are ignored, the cache is only a shortcut)"""  # Docstring.
+    try:  # Home directory may be read-only.
+        with open(path, "w") as f:  # Overwrite.
+            json.dump({"port": port}, f)  # One field.
+    except OSError:  # Can't write.
+        pass  # Next start just searches again.
+
+
+def find_arduino_ports(cached=None):  # Discovery without opening anything.
+    """Return [(port, description)] of likely Arduino ports, the cached port first if it is still present"""  # Docstring.
+    if list_ports is None:  # No descriptors available.
+        return [(cached, "cached")] if cached else []  # Best effort.
+    found = []  # Matching ports.
+    present = set()  # Every port name on the system.
+    for info in list_ports.comports():  # Enumerates descriptors only.
+        present.add(info.device)  # For the cache check.
+        name = board_name(info)  # Known VID/PID?
+        if name:  # Looks like an Arduino.
+            found.append((info.device, f"{name} {info.vid:04X}:{info.pid:04X}"))  # Port and description.
+    if cached in present:  # Last good port still plugged in.
+        found = [(cached, "cached")] + [entry for entry in found if entry[0] != cached]  # Try it first.
+    return found  # May be empty.
+
+
+def wait_ready(ser, timeout=READY_TIMEOUT):  # Startup handshake.
+    """Wait for the firmware's OP_READY frame after the port was opened; return its protocol version or None on timeout"""  # Docstring.
+    decoder = FrameDecoder()  # Bytes before the frame are boot noise.
+    deadline = time.monotonic() + timeout  # Give up here.
+    while time.monotonic() < deadline:  # Until ready or timed out.
+        data = ser.read(ser.in_waiting or 1)  # Blocks up to the port timeout for the first byte.
+        for opcode, _seq, payload in decoder.feed(data):  # Look for the ready frame.
+            if opcode == OP_READY:  # setup() finished.
+                version = payload[0] if payload else 0  # Firmware protocol version.
+                if version != PROTO_VERSION:  # Host and firmware disagree on frame layouts.
+                    print(f"⚠ Firmware protocol version {version}, this host speaks {PROTO_VERSION}")  # Warn, keep going.
+                return version  # Ready.
+    return None  # Old firmware (no OP_READY) or a board that doesn't reset on open.
@@ -0,0 +1,350 @@
+// host implementation of sim/mock : the Arduino API on top of a virtual clock
+#include <Arduino.h>
+#include <Servo.h>
+#include <EEPROM.h>
+#include <avr/sleep.h>
+#include "SimWorld.h"
+#include <deque>
+#include <algorithm>
+
+#define SIM_TIMER0_TICK_US 1024       // millis() interrupt period at 16 MHz , wakes SLEEP_MODE_IDLE
+#define SIM_ECHO_DELAY_US  450        // trigger end -> echo rise of an HC-SR04
+#define SIM_ECHO_NONE_US   38000      // echo length when nothing reflects
+#define SIM_RANGE_MAX_CM   400.0
+#define SIM_MAX_SENSORS    4
+
+volatile uint8_t PORTB , PORTC , PORTD , PINB , PINC , PIND , DDRB , DDRC , DDRD ;
+volatile uint8_t PCICR , PCMSK0 , PCMSK1 , PCMSK2 , SREG ;
+volatile uint8_t TCCR1A , TCCR1B ;
+volatile uint16_t ICR1 , OCR1A , OCR1B , TCNT1 ;
+
+HardwareSerial Serial ;
+EEPROMClass EEPROM ;
+
+extern "C" void PCINT0_vect(void);       // defined by Robot.cpp
+extern "C" void PCINT1_vect(void);
+extern "C" void PCINT2_vect(void);
+
+struct SimEdge {
+  unsigned long t_us ;
+  uint8_t level ;
+} ;
+
+struct SimByte {
+  unsigned long t_us ;
+  uint8_t value ;
+} ;
+
+struct SimSensor {
+  int trig ;
+  int echo ;
+  float obstacle_cm ;
+  std::deque<SimEdge> edges ;   // pending edges of the echo pin , in time order
+} ;
+
+static unsigned long now_us = 0 ;
+static SimSensor sensors[SIM_MAX_SENSORS];
+static int sensor_count = 0 ;
+static std::deque<SimByte> rx ;              // injected serial bytes , in arrival order
+static std::vector<uint8_t> tx ;
+static std::vector<SimServoWrite> servo_log ;
+
+
+/***********************pins************************************************/
+
+static void pin_set(volatile uint8_t *reg , uint8_t pin , uint8_t value)
+{
+    if (value){*reg |= digitalPinToBitMask(pin);}
+    else {*reg &= ~digitalPinToBitMask(pin);}
+}
+
+static bool pin_output_high(int pin)
+{
+    if (pin < 0){return false ;}
+    return *portOutputRegister(digitalPinToPort(pin)) & digitalPinToBitMask(pin);
+}
+
+static void echo_change(int echo_pin , uint8_t level)   // input pin changes and its pin change interrupt runs if enabled
+{
+    pin_set(portInputRegister(digitalPinToPort(echo_pin)) , echo_pin , level);
+    if (!(*digitalPinToPCMSK(echo_pin) & bit(digitalPinToPCMSKbit(echo_pin)))){return ;}
+    if (!(PCICR & bit(digitalPinToPCICRbit(echo_pin)))){return ;}
+
+    switch (digitalPinToPCICRbit(echo_pin))
+    {
+        case 0: PCINT0_vect(); break;
+        case 1: PCINT1_vect(); break;
+        case 2: PCINT2_vect(); break;
+    }
+}
+
+static void sensor_trigger(SimSensor &s , unsigned long pulse_end_us)   // the sensor saw a trigger pulse ending at pulse_end_us
+{
+    if (!s.edges.empty()){return ;}   // still busy with the previous ping
+
+    unsigned long width = SIM_ECHO_NONE_US ;
+    if (s.obstacle_cm >= 0 && s.obstacle_cm <= SIM_RANGE_MAX_CM)
+    {
+        width = (unsigned long)(s.obstacle_cm * 2.0 / 0.0343);
+    }
+    unsigned long rise = pulse_end_us + SIM_ECHO_DELAY_US ;
+    s.edges.push_back({rise , HIGH});
+    s.edges.push_back({rise + width , LOW});
+}
+
+static SimSensor *next_edge_sensor()        // sensor whose pending edge comes first
+{
+    SimSensor *first = 0 ;
+    for (int i = 0 ; i < sensor_count ; i++)
+    {
+        if (!sensors[i].edges.empty() && (!first || sensors[i].edges.front().t_us < first->edges.front().t_us))
+        {
+            first = &sensors[i];
+        }
+    }
+    return first ;
+}
+
+static SimSensor *sensor_on_echo(int pin)
+{
+    for (int i = 0 ; i < sensor_count ; i++)
+    {
+        if (sensors[i].echo == pin){return &sensors[i];}
+    }
+    return 0 ;
+}
+
+
+/***********************simulator***************************************************/
+
+void sim_reset()
+{
+    now_us = 0 ;
+    sensor_count = 0 ;              // wire them again after a reset
+    rx.clear();
+    tx.clear();
+    servo_log.clear();
+}
+
+unsigned long sim_now_us()
+{
+    return now_us ;
+}
+
+void sim_advance_us(unsigned long us)
+{
+    unsigned long target = now_us + us ;
+    SimSensor *s ;
+    while ((s = next_edge_sensor()) != 0 && s->edges.front().t_us <= target)
+    {
+        SimEdge edge = s->edges.front();
+        s->edges.pop_front();
+        if (edge.t_us > now_us){now_us = edge.t_us ;}
+        echo_change(s->echo , edge.level);
+    }
+    now_us = target ;
+}
+
+unsigned long sim_next_event_us()
+{
+    unsigned long next = 0 ;
+    SimSensor *s = next_edge_sensor();
+    if (s){next = s->edges.front().t_us ;}
+    if (!rx.empty() && (next == 0 || rx.front().t_us < next)){next = rx.front().t_us ;}
+    return (next > now_us) ? next : 0 ;
+}
+
+void sim_serial_inject(unsigned long t_us , const uint8_t *data , size_t len)
+{
+    for (size_t i = 0 ; i < len ; i++)
+    {
+        rx.push_back({t_us , data[i]});
+    }
+}
+
+const std::vector<uint8_t> &sim_serial_output()
+{
+    return tx ;
+}
+
+int sim_wire_ultrasonic(uint8_t trig , uint8_t echo)
+{
+    if (sensor_count >= SIM_MAX_SENSORS){return -1 ;}
+    SimSensor &s = sensors[sensor_count];
+    s.trig = trig ;
+    s.echo = echo ;
+    s.obstacle_cm = -1 ;
+    s.edges.clear();
+    return sensor_count++ ;
+}
+
+void sim_set_obstacle_cm(float cm , int sensor)
+{
+    if (sensor >= 0 && sensor < sensor_count){sensors[sensor].obstacle_cm = cm ;}
+}
+
+const std::vector<SimServoWrite> &sim_servo_log()
+{
+    return servo_log ;
+}
+
+
+/***********************Arduino core************************************************/
+
+unsigned long millis(){return now_us / 1000 ;}
+unsigned long micros(){return now_us ;}
+void delay(unsigned long ms){sim_advance_us(ms * 1000);}
+
+void delayMicroseconds(unsigned int us)
+{
+    bool triggering[SIM_MAX_SENSORS];     // the 10 us trigger pulse is the only delay with trig high
+    for (int i = 0 ; i < sensor_count ; i++)
+    {
+        triggering[i] = pin_output_high(sensors[i].trig);
+    }
+    sim_advance_us(us);
+    for (int i = 0 ; i < sensor_count ; i++)
+    {
+        if (triggering[i]){sensor_trigger(sensors[i] , now_us);}
+    }
+}
+
+void pinMode(uint8_t pin , uint8_t mode)
+{
+    pin_set(portModeRegister(digitalPinToPort(pin)) , pin , mode == OUTPUT);
+}
+
+void digitalWrite(uint8_t pin , uint8_t value)
+{
+    pin_set(portOutputRegister(digitalPinToPort(pin)) , pin , value);
+}
+
+int digitalRead(uint8_t pin)
+{
+    return (*portInputRegister(digitalPinToPort(pin)) & digitalPinToBitMask(pin)) ? HIGH : LOW ;
+}
+
+unsigned long pulseIn(uint8_t pin , uint8_t state , unsigned long timeout)   // blocking read_distance() , echo pin HIGH pulses only
+{
+    unsigned long start = now_us ;
+    SimSensor *s = sensor_on_echo(pin);
+    if (!s || state != HIGH || s->edges.size() < 2)
+    {
+        sim_advance_us(timeout);
+        return 0 ;
+    }
+    unsigned long rise = s->edges[0].t_us ;
+    unsigned long fall = s->edges[1].t_us ;
+    if (rise - start > timeout)
+    {
+        sim_advance_us(timeout);
+        return 0 ;
+    }
+    if (fall - rise > timeout)          // pulseIn gives up once the pulse is longer than the timeout
+    {
+        sim_advance_us(rise - start + timeout);
+        return 0 ;
+    }
+    sim_advance_us(fall - start);
+    return fall - rise ;
+}
+
+long map(long x , long in_min , long in_max , long out_min , long out_max)
+{
+    return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min ;
+}
+
+void cli(){}
+void sei(){}
+
+void set_sleep_mode(int){}
+void sleep_enable(){}
+void sleep_disable(){}
+
+void sleep_cpu()
+{
+    unsigned long wake = (now_us / SIM_TIMER0_TICK_US + 1) * SIM_TIMER0_TICK_US ;   // next millis() tick
+    unsigned long next = sim_next_event_us();
+    if (next != 0 && next < wake){wake = next ;}
+    sim_advance_us(wake - now_us);
+}
+
+
+/***********************Serial******************************************************/
+
+void HardwareSerial::begin(unsigned long){}
+
+int HardwareSerial::available()
+{
+    int n = 0 ;
+    for (size_t i = 0 ; i < rx.size() && rx[i].t_us <= now_us ; i++)
+    {
+        n++ ;
+    }
+    return n ;
+}
+
+int HardwareSerial::read()
+{
+    if (rx.empty() || rx.front().t_us > now_us){return -1 ;}
+    uint8_t c = rx.front().value ;
+    rx.pop_front();
+    return c ;
+}
+
+int HardwareSerial::peek()
+{
+    if (rx.empty() || rx.front().t_us > now_us){return -1 ;}
+    return rx.front().value ;
+}
+
+int HardwareSerial::availableForWrite()
+{
+    return 63 ;             // the simulated link never backs up
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+    tx.push_back(c);
+    return 1 ;
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer , size_t size)
+{
+    tx.insert(tx.end() , buffer , buffer + size);
+    return size ;
+}
+
+void HardwareSerial::flush(){}
+
+
+/***********************Servo*******************************************************/
+
+uint8_t Servo::attach(int p)
+{
+    pin = p ;
+    return 0 ;
+}
+
+void Servo::detach()
+{
+    if (pin < 0){return ;}
+    servo_log.push_back({now_us , pin , SIM_SERVO_DETACHED});
+    pin = -1 ;
+}
+
+void Servo::write(int angle)
+{
+    writeMicroseconds(map(constrain(angle , 0 , 180) , 0 , 180 , 544 , 2400));
+}
+
+void Servo::writeMicroseconds(int pulse_us)
+{
+    if (pin < 0){return ;}
+    servo_log.push_back({now_us , pin , pulse_us});
+}
+
+bool Servo::attached()
+{
+    return pin >= 0 ;
+}
@@ -0,0 +1,30 @@
+#ifndef SIM_WORLD_H
+#define SIM_WORLD_H
+// simulator side of the host build : virtual clock , serial link , servo log and the ultrasonic sensors
+// the firmware only sees the Arduino API in sim/mock , the benchmark drives it through these functions
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+#define SIM_SERVO_DETACHED 0      // pulse_us logged by Servo::detach()
+
+struct SimServoWrite {
+  unsigned long t_us ;     // virtual time of the write
+  int pin ;                // servo pin (9 right leg , 10 left leg in Robot.ino)
+  int pulse_us ;           // pulse width , SIM_SERVO_DETACHED after detach()
+} ;
+
+void sim_reset();
+unsigned long sim_now_us();
+void sim_advance_us(unsigned long us);     // moves the clock , echo edges on the way call the pin change interrupt
+unsigned long sim_next_event_us();         // earliest pending serial byte or echo edge after now (0 if none)
+
+void sim_serial_inject(unsigned long t_us , const uint8_t *data , size_t len);   // bytes become readable at t_us
+const std::vector<uint8_t> &sim_serial_output();                                // everything the firmware wrote
+
+int sim_wire_ultrasonic(uint8_t trig , uint8_t echo);    // adds a simulated sensor , returns its index (0 first) , -1 if full
+void sim_set_obstacle_cm(float cm , int sensor = 0);     // distance of the obstacle in front of a sensor , < 0 -> nothing in range
+
+const std::vector<SimServoWrite> &sim_servo_log();
+
+#endif
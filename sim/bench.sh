@@ -0,0 +1,32 @@
+#!/bin/sh
+# builds the firmware for the host (sim/mock instead of the Arduino core) and replays every scenario
+#   sim/bench.sh                      all of sim/scenarios
+#   sim/bench.sh --trace my.txt       extra gait_bench options and scenario files
+#   CPPFLAGS=-DROBOT_SIDE_SENSORS sim/bench.sh sim/scenarios/side/side_sensors.txt   build variants of the sketch
+# exits 1 if the expect lines of any scenario failed (the others still run)
+set -e
+cd "$(dirname "$0")/.."
+mkdir -p sim/build
+cp Robot.ino sim/build/Robot_ino.cpp        # the sketch is plain C++ once Arduino.h is included
+${CXX:-g++} -std=gnu++11 -O2 -Wall -D__AVR_ATmega328P__ -DF_CPU=16000000UL -DSERVO_BACKEND_TIMER1=0 \
+    -Isim/mock -I. -include Arduino.h $CPPFLAGS \
+    -o sim/build/gait_bench sim/build/Robot_ino.cpp *.cpp sim/*.cpp
+
+options=""
+scenarios=""
+for arg in "$@"; do
+    case "$arg" in
+        -*|[0-9]*) options="$options $arg" ;;
+        *) scenarios="$scenarios $arg" ;;
+    esac
+done
+[ -n "$scenarios" ] || scenarios=$(ls sim/scenarios/*.txt)
+failed=""
+for s in $scenarios; do
+    sim/build/gait_bench $options "$s" || failed="$failed $s"    # keep going , report every failing scenario
+    echo
+done
+if [ -n "$failed" ]; then
+    echo "FAILED:$failed"
+    exit 1
+fi
@@ -0,0 +1,530 @@
+// replays a recorded command stream through setup() / loop() of the host build and reports
+// - reaction latency of every command change (frame arrival -> first servo write)
+// - steps per second of each gait
+// - loop() cost on the host (relative numbers , for regressions between two builds)
+// and checks the scenario's expect lines , the exit status is 1 if one of them failed
+//
+// usage : gait_bench [--loop-us N] [--trace] scenario.txt
+//
+// scenario lines ("#" starts a comment) , times in ms from the start :
+//   <t> cmd <F|B|L|R|G|S> [speed]    binary OP_CMD frame
+//   <t> legacy <F|L|R|S>             single ASCII byte (old hosts)
+//   <t> timing <gait|all> <motion_ms> <stop_ms>
+//   <t> preset <0..2>
+//   <t> heartbeat [lease_ms]         OP_HEARTBEAT , arms / renews the command lease
+//   <t> steps <leg:speed:dur> ...    OP_GAIT_STEPS , loads the 'G' gait (leg 0..2 , speed -100..100 , dur M , S or ms)
+//   <t> chunk <start> <total> <leg:speed:dur> ...   one OP_GAIT_STEPS frame as given (partial uploads , lost chunks)
+//   <t> obstacle <cm|none> [to_cm duration_ms]   optional linear approach from cm to to_cm
+//   <t> sensor <index> <cm|none>     static obstacle in front of another sensor (build with -DROBOT_SIDE_SENSORS)
+//   <t> end                          stop the replay (default : 1 s after the last line)
+//
+// expectations , checked after the replay :
+//   <t> expect stopped [window_ms]   no leg moving at t , and none starts within window_ms (default : before the next command or the end)
+//   <t> expect moving [window_ms]    a leg starts moving within window_ms after t (default 1000)
+//   <t> expect latency_max <ms>      every command change reaches the servos within ms (t is ignored)
+//   <t> expect stop_cm <min> [max]   the firmware stopped for an obstacle , every time with the head obstacle
+//                                    between min and max cm (t is ignored)
+
+#include <Arduino.h>
+#include "SimWorld.h"
+#include "../Robot.h"
+#include "../Protocol.h"
+#include "../GaitParams.h"
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+#define BENCH_TRIG_PIN 11     // wiring of Robot.ino
+#define BENCH_ECHO_PIN 12
+#ifdef ROBOT_SIDE_SENSORS
+static const uint8_t bench_side_pins[][2] = {{7 , 8} , {5 , 6}};   // trig , echo of the side sensors in Robot.ino
+#endif
+#define BENCH_STOP_US  1472   // SERVO_STOP_US
+
+void setup();
+void loop();
+
+struct BenchEvent {
+  unsigned long t_us ;
+  std::string action ;
+  std::vector<std::string> args ;
+  int line ;
+} ;
+
+struct BenchCommand {         // a command change seen by the replay
+  unsigned long t_us ;
+  char cmd ;
+  int line ;
+} ;
+
+struct BenchStop {            // the sketch's obstacle flag went up
+  unsigned long t_us ;
+  float cm ;                  // head obstacle distance at that time
+} ;
+
+extern bool obstacle ;        // Robot.ino
+
+static uint8_t bench_seq = 0 ;
+static float ramp_from_cm = -1 ;      // obstacle moving from ramp_from_cm to ramp_to_cm
+static float ramp_to_cm = -1 ;
+static unsigned long ramp_start_us = 0 ;
+static unsigned long ramp_us = 0 ;    // 0 -> the obstacle stands still
+static float head_cm = -1 ;           // obstacle in front of sensor 0 right now , < 0 -> none
+
+
+static void inject_frame(unsigned long t_us , uint8_t opcode , const uint8_t *payload , uint8_t len)   // same framing as robot_protocol.py
+{
+    uint8_t buf[PROTO_MAX_PAYLOAD + 5];
+    buf[0] = PROTO_SYNC ;
+    buf[1] = opcode ;
+    buf[2] = bench_seq++ ;
+    buf[3] = len ;
+    memcpy(&buf[4] , payload , len);
+    buf[4 + len] = crc8(&buf[1] , len + 3 , 0);
+    sim_serial_inject(t_us , buf , len + 5);
+}
+
+static bool load_scenario(const char *path , std::vector<BenchEvent> &events)
+{
+    FILE *f = fopen(path , "r");
+    if (!f)
+    {
+        fprintf(stderr , "can't open %s\n" , path);
+        return false ;
+    }
+    char text[256];
+    int line = 0 ;
+    while (fgets(text , sizeof(text) , f))
+    {
+        line++ ;
+        char *hash = strchr(text , '#');
+        if (hash){*hash = 0 ;}
+
+        std::vector<std::string> words ;
+        for (char *w = strtok(text , " \t\r\n") ; w ; w = strtok(0 , " \t\r\n"))
+        {
+            words.push_back(w);
+        }
+        if (words.empty()){continue ;}
+        if (words.size() < 2)
+        {
+            fprintf(stderr , "%s:%d: expected <time_ms> <action>\n" , path , line);
+            fclose(f);
+            return false ;
+        }
+        BenchEvent ev ;
+        ev.t_us = strtoul(words[0].c_str() , 0 , 10) * 1000UL ;
+        ev.action = words[1];
+        ev.args.assign(words.begin() + 2 , words.end());
+        ev.line = line ;
+        events.push_back(ev);
+    }
+    fclose(f);
+    std::stable_sort(events.begin() , events.end() , [](const BenchEvent &a , const BenchEvent &b){return a.t_us < b.t_us ;});
+    return true ;
+}
+
+static bool world_event(const BenchEvent &ev)   // changes the simulated world at its time instead of injecting serial bytes
+{
+    return ev.action == "obstacle" || ev.action == "sensor" ;
+}
+
+static bool check_event(const BenchEvent &ev)   // expectation , nothing to replay
+{
+    return ev.action == "expect" ;
+}
+
+static bool valid_expect(const BenchEvent &ev)
+{
+    const std::vector<std::string> &a = ev.args ;
+    if (a.empty()){return false ;}
+    if (a[0] == "stopped"){return a.size() <= 2 ;}
+    if (a[0] == "moving"){return a.size() <= 2 ;}
+    if (a[0] == "latency_max"){return a.size() == 2 ;}
+    if (a[0] == "stop_cm"){return a.size() == 2 || a.size() == 3 ;}
+    return false ;
+}
+
+static bool pack_step(const std::string &text , int line , uint8_t *out)   // "leg:speed:dur" -> 3 payload bytes
+{
+    int leg = 0 , speed = 0 ;
+    char dur[8] = "";
+    if (sscanf(text.c_str() , "%d:%d:%7s" , &leg , &speed , dur) != 3)
+    {
+        fprintf(stderr , "line %d: bad step '%s'\n" , line , text.c_str());
+        return false ;
+    }
+    out[0] = leg ;
+    out[1] = (uint8_t)(int8_t) speed ;
+    out[2] = (dur[0] == 'M') ? STEP_MOTION : (dur[0] == 'S') ? STEP_STOP : atoi(dur) / STEP_TICK_MS ;
+    return true ;
+}
+
+static bool apply_event(const BenchEvent &ev , std::vector<BenchCommand> &commands , unsigned long &end_us)
+{
+    const std::vector<std::string> &a = ev.args ;
+    if (ev.action == "cmd" && a.size() >= 1)
+    {
+        uint8_t payload[2] = {(uint8_t) a[0][0] , (uint8_t)(a.size() >= 2 ? atoi(a[1].c_str()) : SPEED_MAX)};
+        inject_frame(ev.t_us , OP_CMD , payload , 2);
+        commands.push_back({ev.t_us , a[0][0] , ev.line});
+    }
+    else if (ev.action == "legacy" && a.size() >= 1)
+    {
+        sim_serial_inject(ev.t_us , (const uint8_t *) a[0].c_str() , 1);
+        commands.push_back({ev.t_us , a[0][0] , ev.line});
+    }
+    else if (ev.action == "timing" && a.size() >= 3)
+    {
+        uint8_t payload[5];
+        payload[0] = (a[0] == "all") ? GAIT_ALL : atoi(a[0].c_str());
+        proto_put_u16(&payload[1] , atoi(a[1].c_str()));
+        proto_put_u16(&payload[3] , atoi(a[2].c_str()));
+        inject_frame(ev.t_us , OP_GAIT_TIMING , payload , 5);
+    }
+    else if (ev.action == "preset" && a.size() >= 1)
+    {
+        uint8_t payload[2] = {GAIT_ALL , (uint8_t) atoi(a[0].c_str())};
+        inject_frame(ev.t_us , OP_GAIT_PRESET , payload , 2);
+    }
+    else if (ev.action == "heartbeat")
+    {
+        uint8_t payload[2];
+        proto_put_u16(payload , a.empty() ? PROTO_LEASE_MS : atoi(a[0].c_str()));
+        inject_frame(ev.t_us , OP_HEARTBEAT , payload , 2);
+    }
+    else if (ev.action == "steps" && a.size() >= 1 && a.size() <= GAIT_SLOT_STEPS)
+    {
+        uint8_t payload[PROTO_MAX_PAYLOAD];
+        for (size_t start = 0 ; start < a.size() ; start += 4)     // 4 steps per frame , like the host
+        {
+            uint8_t len = 2 ;
+            payload[0] = start ;
+            payload[1] = a.size();
+            for (size_t i = start ; i < a.size() && i < start + 4 ; i++ , len += 3)
+            {
+                if (!pack_step(a[i] , ev.line , &payload[len])){return false ;}
+            }
+            inject_frame(ev.t_us , OP_GAIT_STEPS , payload , len);
+        }
+    }
+    else if (ev.action == "chunk" && a.size() >= 3 && a.size() <= 6)
+    {
+        uint8_t payload[PROTO_MAX_PAYLOAD];
+        uint8_t len = 2 ;
+        payload[0] = atoi(a[0].c_str());
+        payload[1] = atoi(a[1].c_str());
+        for (size_t i = 2 ; i < a.size() ; i++ , len += 3)
+        {
+            if (!pack_step(a[i] , ev.line , &payload[len])){return false ;}
+        }
+        inject_frame(ev.t_us , OP_GAIT_STEPS , payload , len);
+    }
+    else if (ev.action == "obstacle" && a.size() >= 1)
+    {
+        ramp_from_cm = (a[0] == "none") ? -1 : atof(a[0].c_str());
+        ramp_us = 0 ;
+        if (a.size() >= 3 && ramp_from_cm >= 0)
+        {
+            ramp_to_cm = atof(a[1].c_str());
+            ramp_start_us = ev.t_us ;
+            ramp_us = strtoul(a[2].c_str() , 0 , 10) * 1000UL ;
+        }
+        sim_set_obstacle_cm(ramp_from_cm);
+        head_cm = ramp_from_cm ;
+    }
+    else if (ev.action == "sensor" && a.size() >= 2)
+    {
+        sim_set_obstacle_cm((a[1] == "none") ? -1 : atof(a[1].c_str()) , atoi(a[0].c_str()));
+    }
+    else if (ev.action == "end")
+    {
+        end_us = ev.t_us ;
+    }
+    else
+    {
+        fprintf(stderr , "line %d: unknown or incomplete action '%s'\n" , ev.line , ev.action.c_str());
+        return false ;
+    }
+    return true ;
+}
+
+static bool moving_pulse(int pulse_us)
+{
+    return pulse_us != SIM_SERVO_DETACHED && pulse_us != BENCH_STOP_US ;
+}
+
+static double report_latency(const std::vector<BenchCommand> &commands)   // returns the worst latency in ms
+{
+    const std::vector<SimServoWrite> &log = sim_servo_log();
+    printf("\nreaction latency (frame arrival -> first servo write)\n");
+    printf("  %8s  %4s  %3s  %10s\n" , "t_ms" , "line" , "cmd" , "latency_ms");
+
+    char current = 0 ;
+    double sum = 0 , worst = 0 ;
+    int n = 0 ;
+    for (size_t i = 0 ; i < commands.size() ; i++)
+    {
+        const BenchCommand &c = commands[i];
+        if (c.cmd == current){continue ;}       // repeats don't change the gait
+        current = c.cmd ;
+        unsigned long next = (i + 1 < commands.size()) ? commands[i + 1].t_us : (unsigned long) -1 ;
+
+        const SimServoWrite *first = 0 ;
+        for (size_t j = 0 ; j < log.size() ; j++)
+        {
+            if (log[j].t_us >= c.t_us && log[j].t_us < next && log[j].pulse_us != SIM_SERVO_DETACHED)
+            {
+                first = &log[j];
+                break ;
+            }
+        }
+        if (!first)
+        {
+            printf("  %8.1f  %4d  %3c  %10s\n" , c.t_us / 1000.0 , c.line , c.cmd , "none");   // e.g. held by an obstacle
+            continue ;
+        }
+        double ms = (first->t_us - c.t_us) / 1000.0 ;
+        printf("  %8.1f  %4d  %3c  %10.3f\n" , c.t_us / 1000.0 , c.line , c.cmd , ms);
+        sum += ms ;
+        worst = std::max(worst , ms);
+        n++ ;
+    }
+    if (n > 0)
+    {
+        printf("  mean %.3f ms , max %.3f ms over %d command changes\n" , sum / n , worst , n);
+    }
+    return worst ;
+}
+
+static void report_steps(const std::vector<BenchCommand> &commands , unsigned long end_us)
+{
+    const std::vector<SimServoWrite> &log = sim_servo_log();
+    const char gaits[] = "FBLRG";
+    double active_s[5] = {0 , 0 , 0 , 0 , 0};
+    int steps[5] = {0 , 0 , 0 , 0 , 0};
+
+    for (size_t i = 0 ; i < commands.size() ; i++)      // time each command was the active one
+    {
+        unsigned long until = (i + 1 < commands.size()) ? commands[i + 1].t_us : end_us ;
+        const char *g = strchr(gaits , commands[i].cmd);
+        if (g && until > commands[i].t_us){active_s[g - gaits] += (until - commands[i].t_us) / 1e6 ;}
+    }
+
+    int last_pulse[32];
+    std::fill(last_pulse , last_pulse + 32 , BENCH_STOP_US);
+    size_t c = 0 ;
+    for (size_t j = 0 ; j < log.size() ; j++)           // a step is a leg going from stopped to moving
+    {
+        const SimServoWrite &w = log[j];
+        while (c + 1 < commands.size() && commands[c + 1].t_us <= w.t_us){c++ ;}
+        bool started = moving_pulse(w.pulse_us) && !moving_pulse(last_pulse[w.pin & 31]);
+        last_pulse[w.pin & 31] = w.pulse_us ;
+        if (!started || commands.empty() || commands[c].t_us > w.t_us){continue ;}
+        const char *g = strchr(gaits , commands[c].cmd);
+        if (g){steps[g - gaits]++ ;}
+    }
+
+    printf("\nsteps per second\n");
+    printf("  %4s  %8s  %6s  %8s\n" , "gait" , "active_s" , "steps" , "steps/s");
+    for (int i = 0 ; i < 5 ; i++)
+    {
+        if (active_s[i] <= 0){continue ;}
+        printf("  %4c  %8.2f  %6d  %8.2f\n" , gaits[i] , active_s[i] , steps[i] , steps[i] / active_s[i]);
+    }
+}
+
+static bool legs_moving_at(unsigned long t_us)    // a moving pulse is in effect on any leg at t_us
+{
+    const std::vector<SimServoWrite> &log = sim_servo_log();
+    int last_pulse[32];
+    std::fill(last_pulse , last_pulse + 32 , BENCH_STOP_US);
+    for (size_t j = 0 ; j < log.size() && log[j].t_us <= t_us ; j++){last_pulse[log[j].pin & 31] = log[j].pulse_us ;}
+    for (int pin = 0 ; pin < 32 ; pin++)
+    {
+        if (moving_pulse(last_pulse[pin])){return true ;}
+    }
+    return false ;
+}
+
+static const SimServoWrite *first_moving_write(unsigned long from_us , unsigned long to_us)   // in [from_us , to_us)
+{
+    const std::vector<SimServoWrite> &log = sim_servo_log();
+    for (size_t j = 0 ; j < log.size() ; j++)
+    {
+        if (log[j].t_us >= from_us && log[j].t_us < to_us && moving_pulse(log[j].pulse_us)){return &log[j];}
+    }
+    return 0 ;
+}
+
+static bool check_expect(const BenchEvent &ev , const std::vector<BenchCommand> &commands , const std::vector<BenchStop> &stops ,
+                         double worst_latency_ms , unsigned long end_us , char *detail , size_t size)
+{
+    const std::vector<std::string> &a = ev.args ;
+    if (a[0] == "stopped")
+    {
+        unsigned long until = end_us ;       // the next command may start the legs again
+        for (size_t i = 0 ; i < commands.size() ; i++)
+        {
+            if (commands[i].t_us > ev.t_us){until = commands[i].t_us ; break ;}
+        }
+        if (a.size() >= 2){until = ev.t_us + strtoul(a[1].c_str() , 0 , 10) * 1000UL ;}   // e.g. until a gait upload completes
+        const SimServoWrite *w = first_moving_write(ev.t_us , until);
+        if (legs_moving_at(ev.t_us)){snprintf(detail , size , "a leg is moving at %.1f ms" , ev.t_us / 1000.0);}
+        else if (w){snprintf(detail , size , "pin %d moves at %.3f ms" , w->pin , w->t_us / 1000.0);}
+        else {snprintf(detail , size , "stopped until %.1f ms" , until / 1000.0);}
+        return !legs_moving_at(ev.t_us) && !w ;
+    }
+    if (a[0] == "moving")
+    {
+        unsigned long window_us = (a.size() >= 2) ? strtoul(a[1].c_str() , 0 , 10) * 1000UL : 1000000UL ;
+        const SimServoWrite *w = first_moving_write(ev.t_us , ev.t_us + window_us);
+        if (w){snprintf(detail , size , "pin %d moves at %.3f ms" , w->pin , w->t_us / 1000.0);}
+        else {snprintf(detail , size , "no leg moves within %lu ms" , window_us / 1000);}
+        return w != 0 ;
+    }
+    if (a[0] == "latency_max")
+    {
+        double limit_ms = atof(a[1].c_str());
+        snprintf(detail , size , "max %.3f ms" , worst_latency_ms);
+        return worst_latency_ms <= limit_ms ;
+    }
+    // stop_cm
+    float min_cm = atof(a[1].c_str());
+    float max_cm = (a.size() >= 3) ? atof(a[2].c_str()) : 1e9 ;
+    if (stops.empty())
+    {
+        snprintf(detail , size , "no obstacle stop");
+        return false ;
+    }
+    for (size_t i = 0 ; i < stops.size() ; i++)
+    {
+        snprintf(detail , size , "stop at %.1f ms with the obstacle at %.1f cm" , stops[i].t_us / 1000.0 , stops[i].cm);
+        if (stops[i].cm < min_cm || stops[i].cm > max_cm){return false ;}
+    }
+    if (stops.size() > 1){snprintf(detail , size , "%zu stops , %s" , stops.size() , std::string(detail).c_str());}
+    return true ;
+}
+
+int main(int argc , char **argv)
+{
+    unsigned long loop_us = 100 ;         // virtual time one loop() pass takes on the AVR
+    bool trace = false ;
+    const char *path = 0 ;
+    for (int i = 1 ; i < argc ; i++)
+    {
+        if (!strcmp(argv[i] , "--loop-us") && i + 1 < argc){loop_us = strtoul(argv[++i] , 0 , 10);}
+        else if (!strcmp(argv[i] , "--trace")){trace = true ;}
+        else {path = argv[i];}
+    }
+    if (!path)
+    {
+        fprintf(stderr , "usage: %s [--loop-us N] [--trace] scenario.txt\n" , argv[0]);
+        return 2 ;
+    }
+
+    std::vector<BenchEvent> events ;
+    if (!load_scenario(path , events)){return 2 ;}
+    unsigned long end_us = events.empty() ? 0 : events.back().t_us + 1000000UL ;
+
+    sim_reset();
+    sim_wire_ultrasonic(BENCH_TRIG_PIN , BENCH_ECHO_PIN);
+#ifdef ROBOT_SIDE_SENSORS
+    for (size_t i = 0 ; i < sizeof(bench_side_pins) / sizeof(bench_side_pins[0]) ; i++)
+    {
+        sim_wire_ultrasonic(bench_side_pins[i][0] , bench_side_pins[i][1]);
+    }
+#endif
+    std::vector<BenchCommand> commands ;
+    for (size_t i = 0 ; i < events.size() ; i++)     // serial bytes carry their own arrival time , obstacles are applied on the way
+    {
+        if (check_event(events[i]))
+        {
+            if (!valid_expect(events[i]))
+            {
+                fprintf(stderr , "line %d: bad expectation\n" , events[i].line);
+                return 2 ;
+            }
+            continue ;
+        }
+        if (world_event(events[i])){continue ;}
+        if (!apply_event(events[i] , commands , end_us)){return 2 ;}
+    }
+
+    setup();
+    size_t next_obstacle = 0 ;
+    std::vector<double> loop_ns ;
+    std::vector<BenchStop> stops ;
+    bool was_obstacle = false ;
+    while (sim_now_us() < end_us)
+    {
+        while (next_obstacle < events.size() && events[next_obstacle].t_us <= sim_now_us())
+        {
+            if (world_event(events[next_obstacle])){apply_event(events[next_obstacle] , commands , end_us);}
+            next_obstacle++ ;
+        }
+
+        if (ramp_us > 0)
+        {
+            unsigned long elapsed = std::min(sim_now_us() - ramp_start_us , ramp_us);
+            head_cm = ramp_from_cm + (ramp_to_cm - ramp_from_cm) * elapsed / ramp_us ;
+            sim_set_obstacle_cm(head_cm);
+        }
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        loop();
+        std::chrono::steady_clock::time_point stop = std::chrono::steady_clock::now();
+        loop_ns.push_back(std::chrono::duration<double , std::nano>(stop - start).count());
+        if (obstacle && !was_obstacle){stops.push_back({sim_now_us() , head_cm});}
+        was_obstacle = obstacle ;
+        sim_advance_us(loop_us);
+    }
+
+    printf("scenario %s : %.1f s simulated , %zu loop() passes , %zu servo writes\n" ,
+           path , end_us / 1e6 , loop_ns.size() , sim_servo_log().size());
+    if (trace)
+    {
+        for (size_t j = 0 ; j < sim_servo_log().size() ; j++)
+        {
+            const SimServoWrite &w = sim_servo_log()[j];
+            printf("  %10.3f ms  pin %2d  %4d us\n" , w.t_us / 1000.0 , w.pin , w.pulse_us);
+        }
+    }
+
+    double worst_latency_ms = report_latency(commands);
+    report_steps(commands , end_us);
+
+    if (!loop_ns.empty())
+    {
+        std::vector<double> sorted(loop_ns);
+        std::sort(sorted.begin() , sorted.end());
+        double sum = 0 ;
+        for (size_t i = 0 ; i < sorted.size() ; i++){sum += sorted[i];}
+        printf("\nloop() cost on this host\n");
+        printf("  mean %.0f ns , p99 %.0f ns , max %.0f ns\n" ,
+               sum / sorted.size() , sorted[sorted.size() * 99 / 100] , sorted.back());
+    }
+
+    int failed = 0 , checked = 0 ;
+    for (size_t i = 0 ; i < events.size() ; i++)
+    {
+        if (!check_event(events[i])){continue ;}
+        if (checked++ == 0){printf("\nexpectations\n");}
+        char detail[96];
+        bool ok = check_expect(events[i] , commands , stops , worst_latency_ms , end_us , detail , sizeof(detail));
+        std::string what ;
+        for (size_t k = 0 ; k < events[i].args.size() ; k++){what += (k ? " " : "") + events[i].args[k];}
+        printf("  %4s  line %3d  %8.1f ms  %-20s  %s\n" , ok ? "ok" : "FAIL" , events[i].line , events[i].t_us / 1000.0 ,
+               what.c_str() , detail);
+        if (!ok){failed++ ;}
+    }
+    if (failed > 0)
+    {
+        printf("  %d of %d expectations failed\n" , failed , checked);
+        return 1 ;
+    }
+    return 0 ;
+}
@@ -0,0 +1,67 @@
+#ifndef SIM_ARDUINO_H
+#define SIM_ARDUINO_H
+// host build of the firmware , the minimum of the Arduino core the sketch uses (see sim/SimArduino.cpp)
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+
+typedef uint8_t byte ;
+typedef bool boolean ;
+
+unsigned long millis();          // virtual clock of the simulator
+unsigned long micros();
+void delay(unsigned long ms);    // advance the virtual clock
+void delayMicroseconds(unsigned int us);
+void pinMode(uint8_t pin , uint8_t mode);
+void digitalWrite(uint8_t pin , uint8_t value);
+int digitalRead(uint8_t pin);
+unsigned long pulseIn(uint8_t pin , uint8_t state , unsigned long timeout);   // answered from the simulated obstacle
+long map(long x , long in_min , long in_max , long out_min , long out_max);
+
+#define constrain(amt , low , high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+#define bit(b) (1UL << (b))
+#define _BV(b) (1 << (b))
+#define noInterrupts() cli()
+#define interrupts() sei()
+
+// Arduino UNO pin mapping : 0..7 PORTD , 8..13 PORTB , 14..19 PORTC
+#define NOT_A_PORT 0
+#define PB 2
+#define PC 3
+#define PD 4
+#define digitalPinToPort(p) ((uint8_t)((p) < 8 ? PD : (p) < 14 ? PB : (p) < 20 ? PC : NOT_A_PORT))
+#define digitalPinToBitMask(p) ((uint8_t)(1 << ((p) < 8 ? (p) : (p) < 14 ? (p) - 8 : (p) - 14)))
+#define portOutputRegister(P) ((P) == PB ? &PORTB : (P) == PC ? &PORTC : &PORTD)
+#define portInputRegister(P) ((P) == PB ? &PINB : (P) == PC ? &PINC : &PIND)
+#define portModeRegister(P) ((P) == PB ? &DDRB : (P) == PC ? &DDRC : &DDRD)
+#define digitalPinToPCICR(p) (((p) >= 0 && (p) <= 19) ? &PCICR : (volatile uint8_t *) 0)
+#define digitalPinToPCICRbit(p) (((p) <= 7) ? 2 : (((p) <= 13) ? 0 : 1))
+#define digitalPinToPCMSK(p) (((p) <= 7) ? &PCMSK2 : (((p) <= 13) ? &PCMSK0 : &PCMSK1))
+#define digitalPinToPCMSKbit(p) (((p) <= 7) ? (p) : (((p) <= 13) ? ((p) - 8) : ((p) - 14)))
+
+class HardwareSerial {
+public:
+  void begin(unsigned long baud);
+  int available();               // bytes injected by the scenario whose arrival time has passed
+  int read();
+  int peek();
+  int availableForWrite();
+  size_t write(uint8_t c);
+  size_t write(const uint8_t *buffer , size_t size);
+  void flush();
+  operator bool() { return true ; }
+} ;
+extern HardwareSerial Serial ;
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef SIM_EEPROM_H
+#define SIM_EEPROM_H
+#include <stdint.h>
+#include <string.h>
+
+#define SIM_EEPROM_SIZE 1024
+
+struct EEPROMClass {         // 1 KB like the ATmega328P , erased (0xFF) at start
+  uint8_t cells[SIM_EEPROM_SIZE];
+  EEPROMClass() { memset(cells , 0xFF , sizeof(cells)); }
+  uint8_t read(int address) { return cells[address] ; }
+  void update(int address , uint8_t value) { cells[address] = value ; }
+  void write(int address , uint8_t value) { cells[address] = value ; }
+  template <typename T> T &get(int address , T &t) { memcpy(&t , &cells[address] , sizeof(T)); return t ; }
+  template <typename T> const T &put(int address , const T &t) { memcpy(&cells[address] , &t , sizeof(T)); return t ; }
+} ;
+extern EEPROMClass EEPROM ;
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef SIM_SERVO_H
+#define SIM_SERVO_H
+#include <stdint.h>
+
+class Servo {             // every pulse width change is logged with its virtual time (sim_servo_log)
+public:
+  uint8_t attach(int pin);
+  void detach();
+  void write(int angle);                  // same 0..180 -> 544..2400 us mapping as the Servo library
+  void writeMicroseconds(int pulse_us);
+  bool attached();
+private:
+  int pin = -1 ;
+} ;
+
+#endif
@@ -0,0 +1,7 @@
+#ifndef SIM_AVR_INTERRUPT_H
+#define SIM_AVR_INTERRUPT_H
+// interrupt handlers become plain functions , the simulator calls them when an input pin changes
+#define ISR(vector) extern "C" void vector(void); extern "C" void vector(void)
+void cli();
+void sei();
+#endif
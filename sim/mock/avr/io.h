@@ -0,0 +1,24 @@
+#ifndef SIM_AVR_IO_H
+#define SIM_AVR_IO_H
+// ATmega328P registers the firmware touches , plain variables in the simulator
+#include <stdint.h>
+
+extern volatile uint8_t PORTB , PORTC , PORTD , PINB , PINC , PIND , DDRB , DDRC , DDRD ;
+extern volatile uint8_t PCICR , PCMSK0 , PCMSK1 , PCMSK2 , SREG ;
+extern volatile uint8_t TCCR1A , TCCR1B ;
+extern volatile uint16_t ICR1 , OCR1A , OCR1B , TCNT1 ;
+
+#define WGM11 1
+#define WGM12 3
+#define WGM13 4
+#define COM1A1 7
+#define COM1B1 5
+#define CS11 1
+#define DDB1 1
+#define DDB2 2
+
+#define PCINT0_vect __vector_3      // pins 8..13
+#define PCINT1_vect __vector_4      // pins 14..19
+#define PCINT2_vect __vector_5      // pins 0..7
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef SIM_AVR_SLEEP_H
+#define SIM_AVR_SLEEP_H
+#define SLEEP_MODE_IDLE 0
+void set_sleep_mode(int mode);
+void sleep_enable();
+void sleep_disable();
+void sleep_cpu();          // jumps the virtual clock to the next interrupt (timer tick , serial byte or echo edge)
+#endif